@@ -0,0 +1,353 @@
+#ifndef RTUNE_HPP
+#define RTUNE_HPP
+
+/**
+ * @brief header-only C++17 front end of the C API.
+ *
+ * rtune::region owns a rtune_region_t, rtune::var<T> and rtune::func<Expr> are typed handles of the rtune_var_t/rtune_func_t
+ * of the region, and rtune::region::guard calls rtune_regin_begin/rtune_region_end in its constructor/destructor. The handles
+ * only hold the C pointers, so get() can be passed to any function of the C API, and reading a value is a typed load of
+ * stvar.v without a dispatch on stvar.type.
+ *
+ * Providers and appliers are lambdas. They are stored in the region, and the C runtime calls them through a function
+ * template instantiated for the lambda type, thus the lambda body is inlined into it. Func expressions such as
+ * rtune::log(a) or 2.0 * a - b are expression templates: the tree is a type, and func<Expr>::eval() is inlined code. A func
+ * that has a native kind (LOG, ABS, DIFF of two vars) is added as that kind so the runtime compiles it with the other funcs
+ * (rtune_func_program.h); any other expression is added as a RTUNE_FUNC_EXT whose provider is the inlined expression.
+ *
+ *     rtune::region r("solver");
+ *     auto threads = r.add_range<int>("threads", 1, 64, 1);
+ *     r.set_applier(threads, [](int n) { omp_set_num_threads(n); });
+ *     auto time = r.add_ext_diff<double>("time", [] { return omp_get_wtime(); });
+ *     r.minimize("min_time", r.add_func("time", time));
+ *     for (...) {
+ *         rtune::region::guard g(r);
+ *         ...
+ *     }
+ */
+#include <array>
+#include <cmath>
+#include <deque>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "rtune_api.h"
+#include "rtune_state_ring.hpp"
+
+#define RTUNE_DEFAULT_NUM_STATES 64 //states kept for an ext var when total_num_states is not given, a list/range var keeps one per value
+
+namespace rtune {
+
+namespace detail {
+
+struct holder_base {
+    virtual ~holder_base() = default;
+};
+
+template <typename F>
+struct holder : holder_base {
+    F f;
+    explicit holder(F f) : f(std::move(f)) {}
+};
+
+//the provider of a var of type T returns T, see rtune_provider_read
+template <typename T, typename F>
+T provider_thunk(void *arg) {
+    return static_cast<holder<F> *>(arg)->f();
+}
+
+//a provider returning R as the void *(*)(void *) of the C API. The cast goes through void (*)(void), which is compatible
+//with any function pointer type
+template <typename R>
+void *(*provider_cast(R (*provider)(void *)))(void *) {
+    return reinterpret_cast<void *(*)(void *)>(reinterpret_cast<void (*)(void)>(provider));
+}
+
+template <typename T, typename F>
+void *(*provider_ptr())(void *) {
+    return provider_cast(&provider_thunk<T, F>);
+}
+
+/**
+ * the applier of the C API has no argument of its own, only the value of the var, i.e. stvar.v, which is also the address
+ * of the var. The lambda is thus kept in stvar.callback_arg of the var, so each var calls its own lambda object and the
+ * lambda lives as long as the region that owns both. The callback of such a var must not be set with rtune_var_set_callback.
+ */
+template <typename T, typename F>
+void *applier_thunk(void *value) {
+    rtune_var_t *v = static_cast<rtune_var_t *>(value);
+    static_cast<holder<F> *>(v->stvar.callback_arg)->f(utype_get<T>(v->stvar.v));
+    return nullptr;
+}
+
+} // namespace detail
+
+/********************************** expression templates ***********************************/
+
+template <typename T> class var;
+
+template <typename E> struct is_expr : std::false_type {};
+
+template <typename T>
+struct constant {
+    T value;
+    double eval() const { return (double) value; }
+    template <typename F> void for_each_var(F &&) const {}
+    static constexpr int num_vars = 0;
+};
+template <typename T> struct is_expr<constant<T>> : std::true_type {};
+
+struct log_op { static double apply(double a) { return std::log(a); } };
+struct abs_op { static double apply(double a) { return std::fabs(a); } };
+struct neg_op { static double apply(double a) { return -a; } };
+struct add_op { static double apply(double a, double b) { return a + b; } };
+struct sub_op { static double apply(double a, double b) { return a - b; } };
+struct mul_op { static double apply(double a, double b) { return a * b; } };
+struct div_op { static double apply(double a, double b) { return a / b; } };
+
+template <typename Op, typename E>
+struct unary {
+    E e;
+    double eval() const { return Op::apply(e.eval()); }
+    template <typename F> void for_each_var(F &&f) const { e.for_each_var(f); }
+    static constexpr int num_vars = E::num_vars;
+};
+template <typename Op, typename E> struct is_expr<unary<Op, E>> : std::true_type {};
+
+template <typename Op, typename L, typename R>
+struct binary {
+    L l;
+    R r;
+    double eval() const { return Op::apply(l.eval(), r.eval()); }
+    template <typename F> void for_each_var(F &&f) const {
+        l.for_each_var(f);
+        r.for_each_var(f);
+    }
+    static constexpr int num_vars = L::num_vars + R::num_vars;
+};
+template <typename Op, typename L, typename R> struct is_expr<binary<Op, L, R>> : std::true_type {};
+
+template <typename E>
+using expr_t = std::conditional_t<std::is_arithmetic<std::decay_t<E>>::value, constant<std::decay_t<E>>, std::decay_t<E>>;
+
+template <typename E>
+expr_t<E> as_expr(E &&e) {
+    return expr_t<E>{std::forward<E>(e)};
+}
+
+template <typename L, typename R>
+using enable_binary = std::enable_if_t<(is_expr<std::decay_t<L>>::value && (is_expr<std::decay_t<R>>::value || std::is_arithmetic<std::decay_t<R>>::value))
+                                       || (std::is_arithmetic<std::decay_t<L>>::value && is_expr<std::decay_t<R>>::value)>;
+
+template <typename L, typename R, typename = enable_binary<L, R>>
+binary<add_op, expr_t<L>, expr_t<R>> operator+(L &&l, R &&r) { return {as_expr(std::forward<L>(l)), as_expr(std::forward<R>(r))}; }
+template <typename L, typename R, typename = enable_binary<L, R>>
+binary<sub_op, expr_t<L>, expr_t<R>> operator-(L &&l, R &&r) { return {as_expr(std::forward<L>(l)), as_expr(std::forward<R>(r))}; }
+template <typename L, typename R, typename = enable_binary<L, R>>
+binary<mul_op, expr_t<L>, expr_t<R>> operator*(L &&l, R &&r) { return {as_expr(std::forward<L>(l)), as_expr(std::forward<R>(r))}; }
+template <typename L, typename R, typename = enable_binary<L, R>>
+binary<div_op, expr_t<L>, expr_t<R>> operator/(L &&l, R &&r) { return {as_expr(std::forward<L>(l)), as_expr(std::forward<R>(r))}; }
+template <typename E, typename = std::enable_if_t<is_expr<std::decay_t<E>>::value>>
+unary<neg_op, expr_t<E>> operator-(E &&e) { return {as_expr(std::forward<E>(e))}; }
+template <typename E, typename = std::enable_if_t<is_expr<std::decay_t<E>>::value>>
+unary<log_op, expr_t<E>> log(E &&e) { return {as_expr(std::forward<E>(e))}; }
+template <typename E, typename = std::enable_if_t<is_expr<std::decay_t<E>>::value>>
+unary<abs_op, expr_t<E>> abs(E &&e) { return {as_expr(std::forward<E>(e))}; }
+
+/*************************************** handles *******************************************/
+
+//typed handle of a var of a region, also the leaf of the func expressions
+template <typename T>
+class var {
+public:
+    static_assert(std::is_arithmetic<T>::value, "rtune::var<T> needs a short, int, long, float or double T");
+    using value_type = T;
+    static constexpr int num_vars = 1;
+
+    var() = default;
+    explicit var(rtune_var_t *v) : v_(v) {}
+
+    T value() const { return detail::utype_get<T>(v_->stvar.v); }
+    operator T() const { return value(); }
+    double eval() const { return (double) value(); }
+    template <typename F> void for_each_var(F &&f) const { f(v_); }
+
+    rtune_var_t *get() const { return v_; }
+
+    void set_update_schedule(rtune_var_update_kind_t update_lt, rtune_var_update_kind_t update_policy, int update_iteration_start,
+                             int update_batch, int update_iteration_stride) {
+        rtune_var_set_update_schedule_attr(v_, update_lt, update_policy, update_iteration_start, update_batch, update_iteration_stride);
+    }
+
+private:
+    rtune_var_t *v_ = nullptr;
+};
+template <typename T> struct is_expr<var<T>> : std::true_type {};
+
+//typed handle of a func of a region. value() is the value computed by the runtime, eval() recomputes it inline from the vars
+template <typename Expr>
+class func {
+public:
+    func() = default;
+    func(rtune_func_t *f, const Expr *expr) : f_(f), expr_(expr) {}
+
+    double value() const { return detail::utype_get<double>(f_->stvar.v); }
+    double eval() const { return expr_->eval(); }
+    rtune_func_t *get() const { return f_; }
+
+    void set_update_schedule(rtune_var_update_kind_t update_lt, rtune_var_update_kind_t update_policy, int update_iteration_start,
+                             int update_batch, int update_iteration_stride) {
+        rtune_func_set_update_schedule_attr(f_, update_lt, update_policy, update_iteration_start, update_batch, update_iteration_stride);
+    }
+
+private:
+    rtune_func_t *f_ = nullptr;
+    const Expr *expr_ = nullptr;
+};
+
+/**************************************** region *******************************************/
+
+class region {
+public:
+    explicit region(const char *name) : name_(name) {
+        region_ = rtune_region_init(&name_[0]);
+    }
+    ~region() {
+        if (region_) rtune_region_fini(region_);
+    }
+    //the region is pointed to by the lambdas and names it stores, thus it is neither copied nor moved
+    region(const region &) = delete;
+    region &operator=(const region &) = delete;
+
+    rtune_region_t *get() const { return region_; }
+
+    //RAII execution of the region
+    class guard {
+    public:
+        explicit guard(region &r) : r_(r.get()) { rtune_regin_begin(r_); }
+        ~guard() { rtune_region_end(r_); }
+        guard(const guard &) = delete;
+        guard &operator=(const guard &) = delete;
+    private:
+        rtune_region_t *r_;
+    };
+
+    template <typename T>
+    var<T> add_list(const char *name, std::vector<T> values, int total_num_states = 0) {
+        std::vector<T> &v = keep(std::move(values));
+        return var<T>((rtune_var_t *) rtune_var_add_list(region_, str(name), states(total_num_states, (int) v.size()),
+                                                         detail::data_type<T>::value, (int) v.size(), v.data(), nullptr));
+    }
+
+    //a step of 0 gives a null handle, as the C API does on error
+    template <typename T>
+    var<T> add_range(const char *name, T begin, T end, T step, int total_num_states = 0) {
+        if (step == 0) return var<T>();
+        int n = (int) ((end - begin) / step) + 1;
+        return var<T>((rtune_var_t *) rtune_var_add_range(region_, str(name), states(total_num_states, n), detail::data_type<T>::value,
+                                                          &begin, &end, &step));
+    }
+
+    //provider is a callable returning the value of the var, e.g. [&] { return counter; }
+    template <typename T, typename F>
+    var<T> add_ext(const char *name, F provider, int total_num_states = 0) {
+        detail::holder<F> &h = keep_callable(std::move(provider));
+        return var<T>((rtune_var_t *) rtune_var_add_ext(region_, str(name), states(total_num_states, 0), detail::data_type<T>::value,
+                                                        detail::provider_ptr<T, F>(), &h));
+    }
+
+    template <typename T, typename F>
+    var<T> add_ext_diff(const char *name, F provider, int total_num_states = 0) {
+        detail::holder<F> &h = keep_callable(std::move(provider));
+        return var<T>((rtune_var_t *) rtune_var_add_ext_diff(region_, str(name), states(total_num_states, 0), detail::data_type<T>::value,
+                                                             detail::provider_ptr<T, F>(), &h));
+    }
+
+    //applier is a callable taking the value of the var, called by the runtime according to apply_policy
+    template <typename T, typename F>
+    void set_applier(var<T> v, F applier, rtune_var_apply_policy_t apply_policy = RTUNE_VAR_APPLY_ON_UPDATE) {
+        if (!v.get()) return;
+        detail::holder<F> &h = keep_callable(std::move(applier));
+        v.get()->stvar.callback_arg = &h;
+        rtune_var_set_applier_policy(v.get(), &detail::applier_thunk<T, F>, apply_policy);
+    }
+
+    template <typename E, typename = std::enable_if_t<is_expr<std::decay_t<E>>::value>>
+    func<expr_t<E>> add_func(const char *name, E &&e) {
+        using X = expr_t<E>;
+        detail::holder<X> &h = keep_callable(as_expr(std::forward<E>(e)));
+        return func<X>(add_native(str(name), h.f, &h), &h.f);
+    }
+
+    template <typename E>
+    rtune_objective_t *minimize(const char *name, const func<E> &f) { return rtune_objective_add_min(region_, str(name), f.get()); }
+    template <typename E>
+    rtune_objective_t *maximize(const char *name, const func<E> &f) { return rtune_objective_add_max(region_, str(name), f.get()); }
+
+private:
+    template <typename X>
+    struct expr_provider {
+        static double call(void *arg) { return static_cast<detail::holder<X> *>(arg)->f.eval(); }
+    };
+
+    //funcs with a native kind
+    template <typename T>
+    rtune_func_t *add_native(char *name, const unary<log_op, var<T>> &x, void *) {
+        return (rtune_func_t *) rtune_func_add_log(region_, name, RTUNE_double, x.e.get());
+    }
+    template <typename T>
+    rtune_func_t *add_native(char *name, const unary<abs_op, var<T>> &x, void *) {
+        return (rtune_func_t *) rtune_func_add_abs(region_, name, RTUNE_double, x.e.get());
+    }
+    template <typename T, typename U>
+    rtune_func_t *add_native(char *name, const binary<sub_op, var<T>, var<U>> &x, void *) {
+        return (rtune_func_t *) rtune_func_add_diff(region_, name, RTUNE_double, x.l.get(), x.r.get());
+    }
+    //any other expression, with the vars of the expression as the inputs of the func so the runtime knows its dependencies
+    template <typename X>
+    rtune_func_t *add_native(char *name, const X &x, void *arg) {
+        std::array<rtune_var_t *, X::num_vars + 1> vars{};
+        int n = 0;
+        x.for_each_var([&](rtune_var_t *v) { vars[n++] = v; });
+        return add_ext_func(name, &expr_provider<X>::call, arg, vars, std::make_index_sequence<X::num_vars>());
+    }
+    template <size_t N, size_t... I>
+    rtune_func_t *add_ext_func(char *name, double (*provider)(void *), void *arg, const std::array<rtune_var_t *, N> &vars,
+                               std::index_sequence<I...>) {
+        return (rtune_func_t *) rtune_func_add_model(region_, RTUNE_FUNC_EXT, name, RTUNE_double,
+                                                     detail::provider_cast(provider), arg, (int) sizeof...(I), vars[I]...);
+    }
+
+    static int states(int total_num_states, int num_values) {
+        return total_num_states > 0 ? total_num_states : (num_values > 0 ? num_values : RTUNE_DEFAULT_NUM_STATES);
+    }
+
+    char *str(const char *s) {
+        names_.emplace_back(s ? s : "");
+        return &names_.back()[0];
+    }
+
+    template <typename T>
+    std::vector<T> &keep(std::vector<T> v) {
+        return keep_callable(std::move(v)).f;
+    }
+
+    template <typename F>
+    detail::holder<F> &keep_callable(F f) {
+        auto h = std::make_unique<detail::holder<F>>(std::move(f));
+        detail::holder<F> &ref = *h;
+        holders_.push_back(std::move(h));
+        return ref;
+    }
+
+    std::string name_;
+    rtune_region_t *region_ = nullptr;
+    std::deque<std::string> names_; //the C API keeps the name pointers
+    std::vector<std::unique_ptr<detail::holder_base>> holders_; //lambdas, expressions and list values, at stable addresses
+};
+
+} // namespace rtune
+
+#endif
@@ -2,14 +2,27 @@
 #define RTUNE_RUNTIME_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
 //#include "rtune_config.h"
 //#include "rtune.h"
 
-#define MAX_NUM_REGIONS 16
-#define MAX_NUM_VARS 8
-#define MAX_NUM_FUNCS 8
+//There is no limit on the number of regions, and vars/funcs/objectives of a region. The following are the initial capacities
+//that are grown by doubling from the region arena when they are used up.
+#define RTUNE_INIT_NUM_REGIONS 64
+#define RTUNE_INIT_NUM_VARS 4
+#define RTUNE_INIT_NUM_FUNCS 4
+#define RTUNE_INIT_NUM_OBJ 2
+#define RTUNE_ARENA_BLOCK_SIZE 4096
 #define MAX_NUM_MODELS 8
-#define MAX_NUM_OBJ 8
+#define MAX_NUM_THREADS 256 //max number of threads of a concurrent region, i.e. of per-thread states
+#define RTUNE_CACHE_LINE_SIZE 64
+
+#if defined(__GNUC__) || defined(__clang__)
+#define RTUNE_CACHE_LINE_ALIGNED __attribute__((aligned(RTUNE_CACHE_LINE_SIZE)))
+#else
+#define RTUNE_CACHE_LINE_ALIGNED
+#endif
 
 typedef enum rtune_data_type {
     RTUNE_short,
@@ -120,6 +133,51 @@ typedef union unified_type {
     void * _typed_value;
 } utype_t;
 
+/**
+ * built-in providers of ext/ext_diff vars. The runtime recognizes them by provider_kind and reads them inline
+ * (see rtune_provider.h) instead of calling the provider function pointer.
+ */
+typedef enum rtune_provider_kind {
+    RTUNE_PROVIDER_USER,   //the provider and provider_arg given by the user
+    RTUNE_PROVIDER_TSC,    //calibrated rdtsc/rdtscp timer, value in seconds (double). provider_arg is the rtune_tsc_timer_t
+    RTUNE_PROVIDER_ENERGY, //powercap energy counters, value in joules (double). provider_arg is the rtune_energy_reader_t
+} rtune_provider_kind_t;
+
+#define RTUNE_POWERCAP_ROOT "/sys/class/powercap"
+#define RTUNE_ENERGY_MAX_ZONES 16
+
+typedef struct rtune_tsc_timer {
+    double seconds_per_tick; //calibrated against CLOCK_MONOTONIC
+    int use_rdtscp; //rdtscp waits for the previous instructions to complete, so the timed region is not reordered
+} rtune_tsc_timer_t;
+
+/**
+ * reader of the energy_uj counters of the top level powercap zones (<root>/intel-rapl:N) under a sysfs root, which
+ * can be a fake directory tree for testing. The files are kept open and read with pread, and the wraparound of each counter
+ * at its max_energy_range_uj is added to a 64-bit total, thus the total energy is monotonic.
+ */
+typedef struct rtune_energy_reader {
+    int num_zones;
+    int fd[RTUNE_ENERGY_MAX_ZONES];
+    uint64_t max_energy_range_uj[RTUNE_ENERGY_MAX_ZONES];
+    uint64_t last_uj[RTUNE_ENERGY_MAX_ZONES];
+    uint64_t total_uj; //energy accumulated across all the zones since the reader is initialized
+} rtune_energy_reader_t;
+
+/**
+ * ring buffer of the sampled states of a var/func. The values are stored as a plain typed array (not utype_t) so that
+ * the samples of a var are contiguous in memory (structure-of-arrays across the vars/funcs of a region), and the kernels
+ * that update and accumulate them are specialized per type and can be vectorized. The capacity is rounded up to a power of two
+ * such that the slot of a state is (index & mask), and once it is full the oldest state is overwritten, thus the memory
+ * of long running jobs is bounded by the capacity.
+ */
+typedef struct rtune_state_ring {
+    void *values;          //typed array of capacity elements, element type is determined by the type of the stvar
+    unsigned int capacity; //power of two
+    unsigned int mask;     //capacity - 1
+    unsigned long head;    //total number of states that have been pushed, the next state is stored at (head & mask)
+} rtune_state_ring_t;
+
 /**
  * stvar stands for state trace variable, introduced for a system to keep track of its state change that can be used for other purpose
  * such as analyzing the trend of the change for building models.
@@ -132,9 +190,9 @@ typedef struct stvar {//The base of var, func and model
     char *name; //a meaningful name
     //an independent variable, dependent variable (func), or model since the way we list the kind in the list declaration defined before.
     rtune_data_type_t type; //var data type such as int, short, float, double
-    void *states; //sampled values of this variables. /opaque typed-array, element type is determined by type
-    int num_states;       //the current number of states
-    int total_num_states; //total number of states to have
+    rtune_state_ring_t states; //sampled values of this variables
+    int num_states;       //the current number of states, i.e. min(states.head, states.capacity)
+    int total_num_states; //total number of states to keep, the ring capacity is this value rounded up to a power of two
 
     void *(*callback) (void *); //A callback can only use the values of the variable, i.e. it cannot change the value of
                                 //of the variable. The callback must return (cannot call setjmp, etc).
@@ -144,6 +202,7 @@ typedef struct stvar {//The base of var, func and model
 
     void *(*provider) (void *);
     void * provider_arg;  //The corresponding application variable if provided, or a function that can be called to read the value
+    rtune_provider_kind_t provider_kind; //RTUNE_PROVIDER_USER unless the var is added with rtune_var_add_ext_builtin/rtune_var_add_ext_diff_builtin
 
     utype_t accu4Begin_or_base4Diff; //for ext vars/funcs that need to be accumulated at the BEGINing of the
                                     //region across iterations, this is the accumulator var. For the diff vars/funcs, this is to store
@@ -192,7 +251,8 @@ typedef struct rtune_var {
     rtune_var_apply_policy_t apply_policy;
 
     int num_uses; //number of functions that use this var
-    struct rtune_func *usedByFuncs[MAX_NUM_VARS]; /* the func/model that directly use this variable as its input */
+    int max_num_uses; //capacity of usedByFuncs
+    struct rtune_func **usedByFuncs; /* the func/model that directly use this variable as its input, allocated from the region arena */
 
     //struct rtune_objective *objs[MAX_NUM_OBJ];
     //int num_objs;
@@ -216,6 +276,32 @@ typedef struct rtune_var {
     }list_range_setting;
 } rtune_var_t;
 
+/**
+ * online fitting of RTUNE_MODEL_LINEAR and RTUNE_MODEL_QUADRATIC funcs by recursive least squares. Each sample of the func
+ * updates the parameters in O(p^2), p being the number of features (1+n for linear, 1+n+n(n+1)/2 for quadratic of n vars),
+ * independent of the number of samples, thus the states of a modeled func do not need to be stored. The features are computed
+ * from the normalized values (not the indices) of the input vars. The arrays are allocated from the region arena. See rtune_model.h.
+ */
+#define RTUNE_MODEL_DEFAULT_FORGETTING 1.0 //no forgetting, < 1.0 (e.g. 0.99) to track a drifting func
+#define RTUNE_MODEL_DEFAULT_CONFIDENCE 0.0 //stddev of the predicted optimum to accept the model, 0 to never stop sampling early
+
+typedef struct rtune_model_rls {
+    rtune_kind_t kind; //RTUNE_MODEL_LINEAR or RTUNE_MODEL_QUADRATIC
+    int n;            //number of input vars
+    int p;            //number of features/parameters
+    double *theta;    //[p] parameters: constant, linear terms, then x_i*x_j for i <= j for quadratic
+    double *P;        //[p][p] inverse of the (weighted) information matrix
+    double *phi;      //[p] features of the sample of rtune_model_update
+    double *Pphi;     //[p] P*phi
+    double *work;     //[n][n+1] to solve for the optimum of a quadratic model
+    double *center;   //[n] the var values are normalized as (x - center) / half_range, i.e. to [-1, 1] over the list/range of the var,
+    double *half_range; //[n] to keep the quadratic features well conditioned
+    double lambda;    //forgetting factor
+    double sse;       //weighted sum of the squared a priori errors
+    long num_samples;
+    double confidence; //stddev of the predicted value at the optimum below which the model is accepted (RTUNE_STATUS_MODELED)
+} rtune_model_rls_t;
+
 /**
  * struct for objective function
  */
@@ -230,15 +316,18 @@ typedef struct rtune_func {
     int update_iteration_stride;    //The number of iterations between each sample
 
     rtune_var_t * active_var; //the variable which is being updated
-    rtune_var_t *input_varcoefs[MAX_NUM_VARS]; /* the input var and coefficient this variable */
+    rtune_var_t **input_varcoefs; /* the input var and coefficient this variable, num_vars+num_coefficients entries allocated from the region arena */
     int num_vars;
     int num_coefficients;
     
     int *input; //The input of var values represented by the index of the state of each variable. 
-                //This is a 2-D array of int [total_num_states][num_vars]
+                //This is a 2-D array of int [states.capacity][num_vars], the row of a state is the same ring slot as the state of the func
 
-    struct rtune_objective *objectives[MAX_NUM_OBJ];
+    struct rtune_objective **objectives; //allocated from the region arena
     int num_objs;
+    int max_num_objs; //capacity of objectives
+
+    rtune_model_rls_t *model; //for RTUNE_MODEL_LINEAR/QUADRATIC funcs
 } rtune_func_t;
 
 typedef enum rtune_objective_kind {
@@ -261,14 +350,24 @@ typedef enum rtune_objective_search_strategy {
     RTUNE_OBJECTIVE_SEARCH_EXHAUSTIVE_ON_THE_FLY,
     RTUNE_OBJECTIVE_SEARCH_UNIMODAL_ON_THE_FLY,
     RTUNE_OBJECTIVE_SEARCH_RANDOM,
-    RTUNE_OBJECTIVE_SEARCH_NELDER_MEAD, //simplex method
+    RTUNE_OBJECTIVE_SEARCH_NELDER_MEAD, //simplex method over the indices of the list/range values of all the vars of the objective
     RTUNE_OBJECTIVE_SEARCH_BINARY_GRADIENT,
     RTUNE_OBJECTIVE_SEARCH_QUATERNARY_GRADIENT,
     RTUNE_OBJECTIVE_SEARCH_OCTAL_GRADIENT,
     RTUNE_OBJECTIVE_SEARCH_HEX_GRADIENT,
     //The inhouse binary gradient approach: given a known number of sorted inputs (x1,x2,...x0,...,xn) for a variable X,
     //x0 is the value in the middle, collect f(x1) (or f(xn)) and f(x0), calculate the gradient g(x1->x0) = (f(x0) - f(x1))/(x0 - x1).
-    //For minization, if g(x1->x0) > 0;
+    //For minization, if g(x1->x0) > 0, the minimum is in (x1, x0], otherwise in [x0, xn). We use the two neighboring values at the middle
+    //to calculate the gradient, thus each round takes 2 probes and halves the range.
+    //QUATERNARY/OCTAL/HEX are the 4/8/16-ary versions: probe 5/9/17 evenly spaced values of the range, and narrow the range to the two
+    //intervals around the best probe, reusing the probes at the new bounds. Vars of an objective are searched one after another.
+    RTUNE_OBJECTIVE_SEARCH_SUCCESSIVE_HALVING,
+    RTUNE_OBJECTIVE_SEARCH_UCB,
+    //SUCCESSIVE_HALVING and UCB search the joint space of all the vars of the objective within the search budget: a set of arms
+    //(configs) is drawn from the Cartesian product, all of them if it is small enough, the default budget is then capped at
+    //their number. SUCCESSIVE_HALVING splits the budget evenly among log2(num_arms) rounds, samples every surviving arm
+    //equally in a round, and keeps the better half. UCB samples the arm with the lowest mean - exploration * sqrt(2 ln(t) /
+    //count), and picks the most sampled arm when the budget is spent.
 } rtune_objective_search_strategy_t;
 
 #define RTUNE_OBJECTIVE_SEARCH_DEFAULT RTUNE_OBJECTIVE_SEARCH_EXHAUSTIVE_ON_THE_FLY
@@ -277,6 +376,210 @@ typedef enum rtune_objective_search_strategy {
 #define DEFAULT_FIDELITY_WINDOW 2
 #define DEFAULT_LOOKUP_WINDOW 4
 
+#define RTUNE_SEARCH_MAX_ARITY 16
+#define RTUNE_SEARCH_DEFAULT_BUDGET 256 //max number of evaluations of an objective before it takes the best config found
+#define RTUNE_SEARCH_MAX_ARMS 128 //arms of SUCCESSIVE_HALVING/UCB, allocated when the search strategy is set
+#define RTUNE_SEARCH_DEFAULT_EXPLORATION 1.0 //UCB exploration, relative to the spread of the arm means
+
+/**
+ * search state of the BINARY/QUATERNARY/OCTAL/HEX_GRADIENT strategies for the var that is being searched. Values are minimized,
+ * the runtime negates the value for MAX objectives.
+ */
+typedef struct rtune_search_bracket {
+    int arity;  //2, 4, 8, 16
+    int left;   //the current range of value indices [left, right] that contains the optimum
+    int right;
+    int num_probes; //number of probes of the current round
+    int probe_index[RTUNE_SEARCH_MAX_ARITY+1];
+    double probe_value[RTUNE_SEARCH_MAX_ARITY+1];
+    unsigned int probe_done; //bitmask of the probes whose values are known
+    int best_index;  //the best index seen so far, -1 before the first probe
+    double best_value;
+    int converged;
+    int num_evaluations;
+} rtune_search_bracket_t;
+
+/**
+ * search state of the NELDER_MEAD strategy on the lattice of value indices of the vars of an objective.
+ * The arrays are allocated from the region arena when the search strategy is set.
+ */
+typedef struct rtune_search_simplex {
+    int n;            //dimension, i.e. num_vars of the objective
+    const int *num_values; //[n] number of unique values of each var, indices are clamped to [0, num_values-1]
+    int *vertices;    //[n+1][n] value indices of the vertices, sorted by value after each step
+    double *values;   //[n+1]
+    int *trial;       //[n] the point that is being evaluated
+    int *reflect;     //[n] the reflected point, kept while the expansion is evaluated
+    double reflect_value;
+    int phase;        //INIT, REFLECT, EXPAND, CONTRACT or SHRINK
+    int vertex;       //the vertex being evaluated in the INIT and SHRINK phase
+    double tolerance; //converged when the values of all the vertices are within tolerance (absolute, as deviation_tolerance) of the best
+    int max_evaluations;
+    int converged;
+    int num_evaluations;
+    int num_steps;    //reflect/expand/contract/shrink steps taken, convergence on tolerance needs at least one
+} rtune_search_simplex_t;
+
+/**
+ * search state of the SUCCESSIVE_HALVING and UCB strategies. Values are minimized. Ties of the means are broken by
+ * preference_right of the vars (the arm with the greater value indices, compared in the order of the vars, for the vars
+ * with preference_right, the smaller ones for the others), and UCB tries first the untried arms whose values have been set
+ * the least often according to count_value. The arrays are allocated from the region arena when the search strategy is set.
+ */
+typedef struct rtune_search_bandit {
+    int n;                       //num_vars of the objective
+    const int *num_values;       //[n] number of unique values of each var
+    const int *preference_right; //[n]
+    int *const *count_value;     //[n] count_value of each var, NULL to not use it
+    int max_arms;                //capacity of the arrays
+    int num_arms;
+    int *arms;                   //[max_arms][n] value indices of the arms
+    double *sum;                 //[max_arms] sum of the values of the samples of each arm
+    long *count;                 //[max_arms]
+    int *alive;                  //[max_arms] arms still in the race in SUCCESSIVE_HALVING, the first num_alive are valid
+    int num_alive;
+    int pulls;                   //SUCCESSIVE_HALVING: samples of each alive arm in the current round
+    int cursor;                  //SUCCESSIVE_HALVING: position in alive of the arm being sampled
+    int pull;                    //SUCCESSIVE_HALVING: samples of the current arm in the current round
+    int current;                 //arm being sampled
+    int ucb;                     //1 for UCB, 0 for SUCCESSIVE_HALVING
+    double exploration;
+    int budget;
+    int num_evaluations;
+    int converged;
+    int best;                    //the arm chosen when converged
+    uint64_t rng;
+} rtune_search_bandit_t;
+
+/**
+ * persistent tuning cache, to warm-start objectives across runs. The cache file is memory-mapped and holds an open-addressing
+ * table of fixed-size entries. The key of an entry is a 64-bit hash of the region name, the objective name, the signature of the
+ * vars of the objective (kind, type, list/range values) and the hardware fingerprint (CPU model and number of CPUs), thus
+ * a changed var or a different machine never hits a stale entry. codeptr_ra is not part of the key since it changes with ASLR.
+ * Lookup is a probe of the mapped table and does not allocate. See rtune_cache.h.
+ */
+#define RTUNE_CACHE_SEQ_RETRIES 1024 //reads of an entry that is being written before the lookup gives up and misses
+#define RTUNE_CACHE_MAGIC 0x52544341u /* "RTCA" */
+#define RTUNE_CACHE_VERSION 1
+#define RTUNE_CACHE_MAX_VARS 8 //objectives with more vars are not cached
+#define RTUNE_CACHE_DEFAULT_NUM_ENTRIES 4096
+
+typedef enum rtune_cache_policy {
+    RTUNE_CACHE_OFF,    //always search from scratch
+    RTUNE_CACHE_TRUST,  //an objective with a cache hit starts in RTUNE_STATUS_OBJECTIVE_MET with the cached config
+    RTUNE_CACHE_VERIFY, //as TRUST, but the first fidelity_window samples of the cached config are checked against the cached value,
+                        //and the objective falls back to a full search if they deviate by more than deviation_tolerance
+} rtune_cache_policy_t;
+
+#define RTUNE_CACHE_DEFAULT_POLICY RTUNE_CACHE_VERIFY
+
+typedef struct rtune_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_size; //sizeof(rtune_cache_entry_t)
+    uint32_t num_entries; //power of two
+} rtune_cache_header_t;
+
+typedef struct rtune_cache_entry {
+    uint64_t key;      //0 for an empty slot, set once by the writer that claims the slot
+    uint32_t seq;      //odd while the entry is being written, readers retry. An odd seq left by a crashed writer is reset by the next writer
+    uint16_t num_vars;
+    uint16_t reserved;
+    int32_t index[RTUNE_CACHE_MAX_VARS]; //converged config[].index of the objective
+    double value;      //objective func value of the converged config
+    uint64_t updated;  //time the entry is written, in seconds since the epoch
+} rtune_cache_entry_t;
+
+typedef struct rtune_cache {
+    int fd;
+    size_t size;
+    rtune_cache_header_t *header;
+    rtune_cache_entry_t *entries;
+    uint64_t hw_fingerprint;
+    int write_lock;    //serializes the writers of this process, flock on fd serializes the processes
+} rtune_cache_t;
+
+/**
+ * how many samples of the objective func are taken for each candidate config. In RTUNE_SAMPLING_FIXED, each candidate is
+ * sampled for the batch_size of the func. In the adaptive modes, the mean and variance of each candidate are tracked with
+ * Welford's algorithm, and a sample further than outlier_mads MADs from the median of the recent samples of the candidate is
+ * rejected, unless RTUNE_SAMPLING_MAX_CONSECUTIVE_REJECTS samples in a row were rejected (the window is then restarted from
+ * that sample, so it follows a shift of the level). A candidate is sampled until its confidence interval (mean +/- t * stderr, t being the Student quantile for the
+ * z given by confidence) no longer overlaps that of the current best, widened by the sampling tolerance, or until max_samples
+ * samples, accepted or rejected, are taken. The tolerance is absolute, in the unit of the objective func values, like
+ * deviation_tolerance. fidelity_window is the min number of samples of a candidate before it can be decided. See rtune_sampling.h.
+ */
+typedef enum rtune_sampling_mode {
+    RTUNE_SAMPLING_FIXED,    //batch_size samples per candidate
+    RTUNE_SAMPLING_ADAPTIVE, //candidates are sampled one at a time, each until it is separated from the best so far
+    RTUNE_SAMPLING_RACING,   //all the candidates are sampled round-robin, and the ones whose lower bound is worse than the upper
+                             //bound of the best are eliminated, until one is left or all the others have max_samples samples
+} rtune_sampling_mode_t;
+
+#define RTUNE_SAMPLING_DEFAULT_CONFIDENCE 1.96 //z of a two-sided 95% interval
+#define RTUNE_SAMPLING_DEFAULT_OUTLIER_MADS 3.0
+#define RTUNE_SAMPLING_DEFAULT_MAX_SAMPLES 64
+#define RTUNE_SAMPLING_DEFAULT_TOLERANCE 0.0 //the confidence intervals alone decide, whatever the unit of the func values
+#define RTUNE_SAMPLING_ROBUST_WINDOW 16 //number of recent samples of a candidate for the median/MAD
+#define RTUNE_SAMPLING_MAX_CONSECUTIVE_REJECTS (RTUNE_SAMPLING_ROBUST_WINDOW / 2)
+
+typedef enum rtune_sampling_decision {
+    RTUNE_SAMPLING_CONTINUE,   //take another sample of the candidate
+    RTUNE_SAMPLING_BETTER,     //the candidate is better than the best, with confidence
+    RTUNE_SAMPLING_WORSE,      //the candidate is worse than the best (or within the sampling tolerance of it), with confidence
+    RTUNE_SAMPLING_EXHAUSTED,  //max_samples samples taken without separation, the means decide and preference_right breaks ties
+} rtune_sampling_decision_t;
+
+typedef struct rtune_sample_stats {
+    long count;      //accepted samples
+    long num_rejected; //samples rejected as outliers, or dropped by a re-centring, they count toward max_samples
+    int consecutive_rejected; //samples rejected in a row
+    long window_count; //accepted samples in the window since it was last re-centred
+    double mean;
+    double m2;       //sum of squared deviations from the mean (Welford)
+    double window[RTUNE_SAMPLING_ROBUST_WINDOW]; //ring of the recent accepted samples
+    int eliminated;  //RTUNE_SAMPLING_RACING
+} rtune_sample_stats_t;
+
+/**
+ * state of the search strategies that do not visit every configuration
+ */
+typedef union rtune_search_state {
+    struct gradient_search {
+        int var; //index of config[] that is being searched, the other vars are fixed at their config[].index
+        rtune_search_bracket_t bracket;
+    } gradient;
+    rtune_search_simplex_t simplex;
+    rtune_search_bandit_t bandit;
+} rtune_search_state_t;
+
+/**
+ * objectives whose best config depends on the context, e.g. the problem size or trip count of the region given by an ext var.
+ * The value of the context var at rtune_regin_begin is mapped in O(1) to one of num_buckets buckets, linearly or by its log2
+ * over [min, max], values out of the range go to the first/last bucket. Each bucket has its own search state and converged
+ * config; when the context moves to another bucket, the search state of the objective is swapped with that of the bucket.
+ * A bucket that is entered for the first time starts its search from the config of the nearest met bucket. With
+ * interpolation, a bucket between two met buckets starts it from the config interpolated (on the value indices) between
+ * them instead. See rtune_context.h.
+ */
+#define RTUNE_CONTEXT_MAX_BUCKETS 64
+
+typedef enum rtune_context_bucketing {
+    RTUNE_CONTEXT_LINEAR, //buckets of equal width over [min, max]
+    RTUNE_CONTEXT_LOG2,   //buckets of equal width over [log2(min), log2(max)], for sizes that vary by orders of magnitude. min > 0
+} rtune_context_bucketing_t;
+
+typedef struct rtune_context_bucket {
+    rtune_status_t status; //RTUNE_STATUS_CREATED before the first visit, RTUNE_STATUS_SAMPLING while searching, RTUNE_STATUS_OBJECTIVE_MET
+    int *index;            //[num_vars] config[].index of the objective in this bucket, allocated from the region arena
+    double value;          //objective func value of the converged config, NaN until the bucket is met
+    rtune_search_state_t search_state; //saved while another bucket is active, into arrays of its own (rtune_context_alloc_search)
+    int num_explore_iterations;
+    rtune_sample_stats_t *sample_stats; //adaptive sampling stats of the bucket, NULL unless sampling_mode is adaptive
+    int best_candidate;
+    long num_hits;         //executions of the region in this bucket
+} rtune_context_bucket_t;
+
 /**
  * @brief ideally, an objective function include a variable to store the value of the function, multiple variables, and an optional array-based binary expression tree for 
  * deriving the function from variables. 
@@ -291,11 +594,11 @@ typedef struct rtune_objective {
     rtune_status_t status;
     //how the configuration that leads to this objective to be met should be applied, apply once or everytime
     rtune_objective_search_strategy_t search_strategy; //when the obj should be evaluated, after the funcs are completed updated or while they are being updated
-    rtune_func_t * inputs[MAX_NUM_VARS];      //The inputs that are used to determine the objectives, typically are either objective function
+    rtune_func_t ** inputs;      //The inputs that are used to determine the objectives, typically are either objective function
                                               // or constant depending on the objective kind
-    utype_t search_cache[MAX_NUM_VARS]; //the search cache is used to store the temp func value that currently meets the objective, but not before all the variables of the
+    utype_t *search_cache; //the search cache is used to store the temp func value that currently meets the objective, but not before all the variables of the
                                         //obj functions are evaluated. E.g. for min objective, it stores the min of the current objective function before it is fully updated.
-    int search_cache_index[MAX_NUM_VARS];
+    int *search_cache_index;
 
     /** var configuration for this objective. To apply the configuration, the applier of each var is called according to the apply_policy of each var, the value applied is what is indexed in this struct*/
     struct config {
@@ -306,9 +609,19 @@ typedef struct rtune_objective {
         int last_iteration_applied; //the last iteration this config is applied
         rtune_var_apply_policy_t apply_policy;  //XXX: Not sure whether we need this objective-specific var apply policy since if each var is independently applied, it has its own apply_policy. We need this 
                                                 //only if there is situation that we need apply a var differently according to the var used by the different objectives
-    } config[MAX_NUM_VARS];
+    } *config; //num_vars entries, allocated from the region arena when the objective is added
     int num_vars; //num of independent variables that impact the objective func, thus the objective
 
+    rtune_search_state_t search_state;
+    int search_budget; //max number of evaluations of the NELDER_MEAD, SUCCESSIVE_HALVING and UCB searches, 0 for the default
+    int num_explore_iterations; //number of iterations spent evaluating configurations before the objective is met
+
+    //persistent tuning cache
+    rtune_cache_policy_t cache_policy;
+    uint64_t cache_key;         //computed when the search strategy of the objective is set, or at the first iteration
+    int cache_verify_remaining; //samples of the cached config still to be checked in RTUNE_CACHE_VERIFY
+    double cache_value;         //value of the cached entry, to check the samples against
+
     int num_funcs_input;                    //num of models in the input, the rest are constant/coefficient
     void *(*callback) (void *);             //callback when the objective is met, or when the objective is used,
     void *callback_arg;
@@ -316,32 +629,333 @@ typedef struct rtune_objective {
     float deviation_tolerance; /* absolute deviation tolerance */
     int fidelity_window; /* consequent number of occurance of meeting the objective goal to accept that the objective is met */
     int lookup_window; //how many states to check around the posibble state that meets the objective */
+
+    //adaptive sampling
+    rtune_sampling_mode_t sampling_mode;
+    double sampling_confidence;  //z of the confidence interval
+    double sampling_outlier_mads; //0 to keep all the samples
+    double sampling_tolerance;   //absolute, in the unit of the func values
+    int sampling_max_samples;    //per candidate
+    rtune_sample_stats_t *sample_stats; //[num_candidates] indexed by the linearized config, allocated from the region arena
+    int num_candidates;
+    int best_candidate;          //-1 before the first candidate is decided
+
+    //context buckets, set by rtune_objective_set_context
+    rtune_var_t *context_var;    //NULL if the objective has a single config
+    rtune_context_bucketing_t context_bucketing;
+    double context_min;          //min, or log2(min) for RTUNE_CONTEXT_LOG2
+    double context_scale;        //num_buckets / (max - min), in log2 for RTUNE_CONTEXT_LOG2
+    int num_context_buckets;
+    int context_interpolate;
+    int context_bucket;          //the active bucket, whose state is in the fields of the objective, -1 before the first iteration
+    rtune_context_bucket_t *context_buckets; //[num_context_buckets] allocated from the region arena
 } rtune_objective_t;
 
+/**
+ * per-thread sampling buffer of a var or func. In the concurrent sampling mode, each thread only writes to its own buffer
+ * in rtune_regin_begin/rtune_region_end, thus no lock or atomic is needed on the hot path. The buffers of all the threads
+ * are merged into the states and accumulators of the stvar when a batch completes (RTUNE_UPDATE_BATCH_ACCUMULATE), or
+ * for each iteration for the other update policies.
+ */
+typedef struct rtune_stvar_tls {
+    utype_t accu4Begin_or_base4Diff; //per-thread copy of stvar_t.accu4Begin_or_base4Diff
+    utype_t accu4End_or_accu4Diff;   //per-thread copy of stvar_t.accu4End_or_accu4Diff
+    void *states;   //per-thread samples not merged yet, element type is determined by the type of the stvar
+    int num_states; //number of samples in the buffer since the last merge
+} rtune_stvar_tls_t;
+
+/**
+ * self-profiling of the RTune overhead. Compiled in when RTUNE_PROFILE is defined, and enabled at run time with
+ * rtune_profile_enable or the RTUNE_PROFILE environment variable. The latency of each probe is recorded in a histogram with
+ * log2-sized buckets: bucket i counts latencies in [2^i, 2^(i+1)) nanoseconds, bucket 0 also counts 0ns.
+ */
+typedef enum rtune_profile_probe {
+    RTUNE_PROFILE_REGION_BEGIN,  //rtune_regin_begin, including the providers, appliers and objectives called by it
+    RTUNE_PROFILE_REGION_END,    //rtune_region_end, including the providers, appliers and objectives called by it
+    RTUNE_PROFILE_PROVIDER,      //a call to a var provider
+    RTUNE_PROFILE_APPLIER,       //a call to a var applier
+    RTUNE_PROFILE_OBJECTIVE,     //evaluation of an objective
+    RTUNE_PROFILE_REGION_BODY,   //the region itself, from the return of rtune_regin_begin to the call of rtune_region_end
+    RTUNE_PROFILE_NUM_PROBES,
+} rtune_profile_probe_t;
+
+#define RTUNE_PROFILE_NUM_BUCKETS 40 //up to 2^40ns, about 18 minutes
+
+typedef struct rtune_profile_hist {
+    uint64_t buckets[RTUNE_PROFILE_NUM_BUCKETS];
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+} rtune_profile_hist_t;
+
+typedef struct rtune_profile {
+    rtune_profile_hist_t hist[RTUNE_PROFILE_NUM_PROBES];
+    uint64_t body_start; //tick when rtune_regin_begin returns
+} rtune_profile_t;
+
+/**
+ * per-thread state of a region. Each one is aligned and padded to cache lines so that threads that hit the same
+ * region never write to the same cache line.
+ */
+typedef struct rtune_region_tls {
+    int count;       //number of executions of the region by this thread
+    int batch_count; //number of executions by this thread in the current batch, reset when the buffers are merged
+    rtune_stvar_tls_t *vars;  //num_vars entries, allocated from the region arena with the funcs and the sample buffers of the thread
+    rtune_stvar_tls_t *funcs; //num_funcs entries, following vars
+    int states_capacity;      //samples each buffer of vars/funcs holds between merges
+    rtune_profile_t *profile; //NULL unless profiling is enabled. Not under RTUNE_PROFILE, so the layout is the same in all builds
+} RTUNE_CACHE_LINE_ALIGNED rtune_region_tls_t;
+
+/**
+ * asynchronous mode. rtune_region_end only publishes the sample of the iteration, i.e. the values of the vars that are
+ * updated at the end, to the sample queue of the region, and returns. A background worker thread pops the samples, updates the
+ * funcs and evaluates the objectives (search_cache and config[]), and publishes the configuration to apply as a new
+ * rtune_config_snapshot_t. rtune_regin_begin reads the current snapshot with an acquire load of the pointer, and only applies it
+ * if its version is not the one it applied last, thus no lock or read-modify-write is on the begin path. See rtune_async.h for the queue and snapshot kernels.
+ */
+#define RTUNE_ASYNC_DEFAULT_QUEUE_CAPACITY 1024
+#define RTUNE_ASYNC_NUM_SNAPSHOTS 4 //the worker rotates through the snapshots, thus a snapshot is only rewritten after 3 newer ones are published
+
+typedef struct rtune_async_slot {
+    uint64_t seq;       //sequence number of the bounded MPMC queue, tells whether the slot is free or holds a sample
+    int iteration;      //count of the region when the sample is taken
+    int thread;
+    uint64_t config_version; //version of the snapshot applied when the sample was taken, the worker drops samples of stale configurations
+} rtune_async_slot_t;
+
+typedef struct rtune_async_queue {
+    uint64_t tail RTUNE_CACHE_LINE_ALIGNED; //next position to publish, advanced by the threads calling rtune_region_end
+    uint64_t head RTUNE_CACHE_LINE_ALIGNED; //next position to pop, advanced by the worker
+    unsigned int capacity RTUNE_CACHE_LINE_ALIGNED; //power of two
+    unsigned int mask;
+    int num_values;     //values per sample, i.e. the number of vars of the region
+    rtune_async_slot_t *slots;
+    utype_t *values;    //[capacity][num_values], the values of the sample in slot i are at values + i*num_values
+    uint64_t num_dropped; //samples dropped because the queue was full
+} rtune_async_queue_t;
+
+typedef struct rtune_config_snapshot {
+    uint64_t version; //odd while the worker writes the snapshot, a reader that sees it changed while copying retries
+    int *index;       //[num_vars] index of the value of each var of the region to apply, -1 if the var is not configured by an objective
+} rtune_config_snapshot_t;
+
+/**
+ * node-local coordination of the ranks (processes) on a node for the _sync region calls, instead of a global collective
+ * in each iteration. Each region has a POSIX shared memory segment, <shm_prefix>.<region id>, shared by the local ranks. The
+ * configurations of the region (the combinations of the list/range values of the vars of its objective) are split among
+ * the ranks, configuration c is explored by rank c % num_ranks. The samples of all the ranks are pooled into one table in the
+ * segment, and the ranks only meet at a barrier to agree on the winning configuration once all the configurations are sampled.
+ * Local rank 0 removes a segment left by a crashed job and creates a new one, the other ranks only attach a segment whose
+ * creator is alive. The prefix must thus differ between jobs that run on the node at the same time. See rtune_node.h.
+ */
+#define RTUNE_NODE_MAGIC 0x52544e44u /* "RTND" */
+#define RTUNE_NODE_ATTACH_TIMEOUT_MS 30000 //how long the other local ranks wait for local rank 0 to create the segment
+
+typedef struct rtune_node_barrier {
+    uint32_t count;      //number of ranks that have arrived
+    uint32_t generation; //incremented by the last rank to arrive, the others spin and then futex-wait on it
+} rtune_node_barrier_t;
+
+typedef struct rtune_node_stat { //pooled samples of a configuration
+    double sum;
+    uint64_t count;
+} rtune_node_stat_t;
+
+typedef struct rtune_node_shared { //followed by the rtune_node_stat_t of the num_configs configurations, see rtune_node_stats
+    uint32_t magic;      //set by rank 0 once the header is set up
+    uint32_t num_ranks;
+    uint32_t num_configs;
+    uint32_t attached;   //number of ranks that have attached
+    int32_t creator_pid; //pid of rank 0, a segment whose creator is gone is left by a crashed job
+    rtune_node_barrier_t barrier RTUNE_CACHE_LINE_ALIGNED;
+    int32_t winner_plus_one RTUNE_CACHE_LINE_ALIGNED; //the agreed configuration plus one, 0 before the ranks agree
+    uint32_t round;      //number of agreements, a region that retunes agrees again
+} rtune_node_shared_t;
+
+/**
+ * compiled func graph. The funcs of a region form a DAG over its vars (input_varcoefs, usedByFuncs). At the end of the setup
+ * (rtune_region_compile, or the first execution of the region) it is compiled into a flat array of instructions in topological
+ * order. Each var and func has a register, which is a row of batch_capacity doubles, so an instruction is evaluated over all
+ * the states of a batch at once in a loop the compiler vectorizes. A func is only recomputed if one of its inputs has changed
+ * since the last evaluation (dirty bitmask). See rtune_func_program.h.
+ */
+typedef enum rtune_func_op {
+    RTUNE_FUNC_OP_LOG,       //dst = log(src0)
+    RTUNE_FUNC_OP_ABS,       //dst = |src0|
+    RTUNE_FUNC_OP_DIFF,      //dst = src0 - src1, also used for RTUNE_FUNC_DISTANCE
+    RTUNE_FUNC_OP_THRESHOLD, //dst = src0 < src1 ? 0 : 1
+    RTUNE_FUNC_OP_GRADIENT,  //dst = src0 - previous state of src0
+    RTUNE_FUNC_OP_CONST,     //dst = imm
+    RTUNE_FUNC_OP_MUL_ADD,   //dst += src0 * src1, a linear RTUNE_FUNC is compiled to COPY (or CONST 0) followed by MUL_ADDs,
+                             //src1 being the register of a coefficient var
+    RTUNE_FUNC_OP_COPY,      //dst = src0
+} rtune_func_op_t;
+
+typedef struct rtune_func_insn {
+    uint16_t op;   //rtune_func_op_t
+    uint16_t dst;  //register of the func
+    uint16_t src0; //registers of the inputs, vars are registers 0..num_vars-1 and funcs are num_vars..num_vars+num_funcs-1,
+                   //thus a region with more than RTUNE_FUNC_MAX_REGS vars and funcs is not compiled
+    uint16_t src1;
+    double imm;
+} rtune_func_insn_t;
+
+typedef struct rtune_func_program {
+    int num_insns;
+    rtune_func_insn_t *insns;
+    int num_groups;      //one group of instructions per compiled func, in topological order
+    int *group_begin;    //[num_groups+1] the instructions of group g are [group_begin[g], group_begin[g+1])
+    int num_regs;        //num_vars + num_funcs
+    int batch_capacity;  //max number of states evaluated at once
+    int batch_size;      //number of states in the registers
+    double *regs;        //[num_regs][batch_capacity]
+    double *prev;        //[num_regs] last state of the previous batch, for GRADIENT, NaN before the first batch
+    double *consts;      //[num_regs] value of the last rtune_func_program_load_const of the register, NaN before the first
+    uint64_t *dirty;     //[(num_regs+63)/64] registers changed since the last evaluation
+} rtune_func_program_t;
+
+#define RTUNE_FUNC_MAX_REGS 65536 //registers are uint16_t
+
+/**
+ * open-addressing map from the pointer of a var or func of a region to its register, built once by rtune_func_program_compile
+ * so that the inputs of the funcs are not looked up by scanning the vars and funcs of the region.
+ */
+typedef struct rtune_func_reg_map {
+    uint32_t mask;     //capacity - 1, the capacity is a power of two of at least twice the number of registers
+    const void **keys; //[capacity] NULL for an empty slot
+    int *regs;         //[capacity]
+} rtune_func_reg_map_t;
+
+/**
+ * bump-pointer arena from which a region and all its vars, funcs, objectives and their arrays are allocated. Blocks
+ * are chained and never moved, thus the pointers to vars/funcs returned to the user stay valid when the region grows.
+ * The whole arena is freed at once when the region is destroyed. See rtune_region.h.
+ */
+typedef struct rtune_arena_block {
+    struct rtune_arena_block *next;
+    size_t size; //size of the data, which follows the header at RTUNE_ARENA_ALIGN alignment
+    size_t used; //number of bytes of data that are allocated
+} rtune_arena_block_t;
+
+#define RTUNE_ARENA_ALIGN 16
+
+typedef struct rtune_arena {
+    rtune_arena_block_t *head; //the block that is currently allocated from
+    size_t total_size;
+} rtune_arena_t;
+
+/**
+ * binary trace. Each thread appends fixed-size records to its own memory-mapped file, <prefix>.<thread>.rtt, thus no lock
+ * is taken when a record is written. A file is a rtune_trace_header_t followed by num_records rtune_trace_record_t.
+ * rtune_trace.hpp provides the writer and the reader, and tools/rtune_trace2csv converts trace files to CSV.
+ */
+typedef enum rtune_trace_mode {
+    RTUNE_TRACE_NONE,
+    RTUNE_TRACE_TEXT,   //text log to rtune_logfile
+    RTUNE_TRACE_BINARY, //binary records to the per-thread trace file
+} rtune_trace_mode_t;
+
+typedef enum rtune_trace_record_kind {
+    RTUNE_TRACE_RECORD_VAR,       //a new state of a var
+    RTUNE_TRACE_RECORD_FUNC,      //a new state of a func
+    RTUNE_TRACE_RECORD_OBJECTIVE, //status transition of an objective
+} rtune_trace_record_kind_t;
+
+#define RTUNE_TRACE_MAGIC 0x52545452u /* "RTTR" */
+#define RTUNE_TRACE_VERSION 1
+#define RTUNE_TRACE_INIT_NUM_RECORDS 4096 //initial capacity of a trace file, which is doubled when it is full
+
+typedef struct rtune_trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size; //sizeof(rtune_trace_record_t)
+    uint32_t thread_id;
+    uint64_t num_records; //number of valid records, updated after each record is written
+} rtune_trace_header_t;
+
+typedef struct rtune_trace_record {
+    uint32_t region_id;
+    uint32_t iteration;   //count of the region when the record is written
+    uint16_t kind;        //rtune_trace_record_kind_t
+    uint16_t id;          //index of the var, func or objective in the region
+    uint16_t type;        //rtune_data_type_t of value
+    uint16_t status;      //for objectives, the new status
+    int32_t state_index;  //for vars/funcs, index of the state; for objectives, the old status
+    int32_t reserved;
+    utype_t value;        //for vars/funcs, value of the state; for objectives, value of the objective func
+} rtune_trace_record_t;
+
+typedef struct rtune_trace_file { //per-thread trace file being written
+    int fd;
+    rtune_trace_header_t *header; //start of the mapping
+    rtune_trace_record_t *records;
+    uint64_t capacity; //number of records the mapping can hold
+} rtune_trace_file_t;
+
 typedef struct rtune_region {
     char * name;
+    int id; //the order the region is initialized, used to identify the region in trace records
     rtune_status_t status;
     const void *codeptr_ra;
     const void *end_codeptr;
     const void *end_codeptr2;
     int count; /* total number of execution of the region */
 
+    //concurrent sampling mode, in which the region can be called by multiple OpenMP threads at the same time
+    int concurrent; //set by rtune_region_set_concurrent
+    int max_num_threads; //number of entries of tls
+    rtune_region_tls_t *tls; //per-thread buffers, indexed by omp_get_thread_num(). A region that is not concurrent has one entry when profiling is enabled
+    int merge_lock; //only taken by the thread that completes a batch to merge the per-thread buffers, never on the hot path
+
+    rtune_arena_t arena; //memory of the region and its members
+    rtune_func_program_t *func_program; //compiled funcs, NULL before the region is compiled
+
     int num_vars; //number of variables for a tuning region
+    int max_num_vars; //capacity of vars
     //rtune variables include both system/perf variable and user variables. System/perf variable are those
     //related to performance objectives, e.g. timestamp, frequency, power/energy read, and even CPU counters
     //user variables are user provided variables for tuning certain objectives
-    rtune_var_t vars[MAX_NUM_VARS];
+    //Each var/func/objective is allocated individually from the arena, and these are arrays of pointers to them,
+    //so only the pointer arrays are reallocated (doubled) when they are grown.
+    rtune_var_t **vars;
 
-    rtune_func_t funcs[MAX_NUM_FUNCS];
+    rtune_func_t **funcs;
     int num_funcs;
+    int max_num_funcs;
 
     //model definition
-    rtune_objective_t objs[MAX_NUM_OBJ];
+    rtune_objective_t **objs;
     int num_objs;
+    int max_num_objs;
 
     FILE * rtune_logfile;
+    rtune_trace_mode_t trace_mode;
+
+    //asynchronous mode, set by rtune_region_set_async
+    int async;
+    rtune_async_queue_t *sample_queue;
+    rtune_config_snapshot_t *config_current;   //published by the worker with a release store, read by rtune_regin_begin with an acquire load
+    rtune_config_snapshot_t *config_snapshots; //RTUNE_ASYNC_NUM_SNAPSHOTS snapshots allocated from the arena
+
+    //node-local coordination of rtune_regin_begin_sync/rtune_region_end_sync, set by rtune_region_set_node_sync
+    rtune_node_shared_t *node_shared; //mapping of the shared memory segment of the region, NULL if the _sync calls use the global collective
+    int node_rank;
+    int node_num_ranks;
 } rtune_region_t;
 
+/**
+ * open-addressing hash index of all the regions keyed on codeptr_ra, with linear probing. The capacity is a power of two and
+ * the table is rehashed when it is more than half full, which only happens in rtune_region_init. Lookup does not allocate
+ * and is O(1) in the number of regions.
+ */
+typedef struct rtune_region_index {
+    const void **keys;         //codeptr_ra of the regions, NULL for an empty slot
+    rtune_region_t **regions;
+    int capacity;
+    int num_regions;
+} rtune_region_index_t;
+
 //extern rtune_region_t * rtune_regions;
 //extern int num_regions;
 
@@ -363,10 +977,43 @@ extern "C" {
  */
  
 rtune_region_t * rtune_region_init(char * name);
+rtune_region_t * rtune_region_lookup(const void * codeptr_ra); //find the region of a code location, NULL if there is no region for it
+//compile the funcs of the region after all of them are added. Called by the first rtune_regin_begin if not called by the user.
+//Return -1 if the funcs have a cycle
+int rtune_region_compile(rtune_region_t * region);
+void rtune_region_fini(rtune_region_t * region); //free the region and everything allocated from its arena
 void rtune_regin_begin(rtune_region_t * region);
 void rtune_region_end(rtune_region_t * end);
-void rtune_regin_begin_sync(rtune_region_t * region); //the call will synced across multiple process, e.g. via MPI_Barrier
+void rtune_regin_begin_sync(rtune_region_t * region); //the call will synced across multiple process, e.g. via MPI_Barrier, or node-locally if rtune_region_set_node_sync is called
 void rtune_region_end_sync(rtune_region_t * end);
+//coordinate the _sync calls of the region among num_local_ranks ranks on the node through shared memory, local_rank being 0..num_local_ranks-1.
+//Must be called by every local rank after the objectives of the region are added. Return 0 on success, -1 if the segment cannot be created or mapped,
+//or if local rank 0 has not created it within RTUNE_NODE_ATTACH_TIMEOUT_MS
+int  rtune_region_set_node_sync(rtune_region_t * region, const char * shm_prefix, int local_rank, int num_local_ranks);
+//enable concurrent sampling so that rtune_regin_begin/rtune_region_end can be called by up to max_num_threads threads at the same time
+//for the region; max_num_threads is clamped to MAX_NUM_THREADS. Must be called after all the vars/funcs are added and before the region is first executed.
+void rtune_region_set_concurrent(rtune_region_t * region, int max_num_threads);
+//merge the per-thread buffers of a concurrent region into the states of its vars and funcs. It is called by the runtime when
+//a batch completes, and can be called by the user at the end of a parallel region to flush partial batches. See rtune_region_tls_merge.
+void rtune_region_merge_thread_states(rtune_region_t * region);
+//set the path prefix of the binary trace files. Each thread writes to <prefix>.<thread>.rtt, the files are created when the thread first writes a record
+void rtune_trace_set_prefix(const char * prefix);
+void rtune_region_set_trace(rtune_region_t * region, rtune_trace_mode_t mode);
+void rtune_trace_flush(void); //sync the trace files of all threads to disk, e.g. before the program exits
+
+//self-profiling, effective only when RTune is compiled with RTUNE_PROFILE
+void rtune_profile_enable(int enable);
+//histogram of a probe of a region for a thread, or merged over all the threads if thread is -1. Return -1 if profiling is not enabled
+int rtune_region_profile_get(rtune_region_t * region, int thread, rtune_profile_probe_t probe, rtune_profile_hist_t * hist);
+//RTune overhead (begin + end) as a fraction of the time of the region body, merged over all the threads
+double rtune_region_profile_overhead(rtune_region_t * region);
+void rtune_region_profile_dump(rtune_region_t * region, FILE * out); //print the histograms of all the probes and threads of the region
+
+//asynchronous mode: the objectives of the region are evaluated by the background worker instead of in rtune_region_end.
+//queue_capacity is rounded up to a power of two, RTUNE_ASYNC_DEFAULT_QUEUE_CAPACITY if it is 0
+void rtune_region_set_async(rtune_region_t * region, int queue_capacity);
+void rtune_async_start(void); //start the worker thread that serves all the async regions, called by the first rtune_region_set_async
+void rtune_async_stop(void);  //process the samples left in the queues and join the worker, e.g. before the program exits
 
 //API for creating independent variables. A variable has its predefined set of values. The current value of the variable is updated
 //by either the pre-set values or from external provider
@@ -376,6 +1023,10 @@ void *rtune_var_add_list(rtune_region_t *region, char *name, int total_num_state
 void* rtune_var_add_range(rtune_region_t *region, char * name, int total_num_states, rtune_data_type_t type, void * rangeBegin, void * rangeEnd, void * step);
 void* rtune_var_add_ext(rtune_region_t *region, char * name, int total_num_states, rtune_data_type_t type, void *(*provider) (void *), void * provider_arg);
 void* rtune_var_add_ext_diff(rtune_region_t *region, char * name, int total_num_states, rtune_data_type_t type, void *(*provider) (void *), void * provider_arg);
+//ext/ext_diff vars with a built-in provider, the type is RTUNE_double. provider_arg is the rtune_tsc_timer_t or rtune_energy_reader_t, or NULL
+//to use the one of the runtime (calibrated timer, and energy reader of RTUNE_POWERCAP_ROOT or $RTUNE_POWERCAP_ROOT)
+void* rtune_var_add_ext_builtin(rtune_region_t *region, char * name, int total_num_states, rtune_provider_kind_t provider_kind, void * provider_arg);
+void* rtune_var_add_ext_diff_builtin(rtune_region_t *region, char * name, int total_num_states, rtune_provider_kind_t provider_kind, void * provider_arg);
 void  rtune_var_set_update_schedule_attr(rtune_var_t * var, rtune_var_update_kind_t update_lt, rtune_var_update_kind_t update_policy, int update_iteration_start, int update_batch, int update_iteration_stride);
 void  rtune_var_set_callback(rtune_var_t *var, void *(*callback) (void *), void *arg); //can be used for adding callbacks for var, func and models
 void  rtune_var_set_applier_policy(rtune_var_t *var, void *(*applier) (void *), rtune_var_apply_policy_t apply_policy); //to set the applier and policy of the var
@@ -396,6 +1047,12 @@ void* rtune_func_add_distance(rtune_region_t *region, char * name, rtune_data_ty
 void* rtune_func_add(rtune_region_t * region, rtune_kind_t kind, char * name, rtune_data_type_t type, int num_vars, int num_coefficients, ...);
 //add a function that will be modeled based on the input and function value, input are knowns, but not the function.
 void* rtune_func_add_model(rtune_region_t * region, rtune_kind_t kind, char * name, rtune_data_type_t type,void *(*provider) (void *), void * provider_arg, int num_vars, ...);
+//forgetting factor and confidence of a linear/quadratic model. If keep_states is 0, the states of the func and its input[] are not stored
+void  rtune_func_set_model_attr(rtune_func_t * func, double forgetting, double confidence, int keep_states);
+//predicted value and its stddev of a linear/quadratic model at the var values x[num_vars]. Return -1 if the model has fewer samples than parameters
+int   rtune_func_model_predict(rtune_func_t * func, const double * x, double * value, double * stddev);
+//var values x[num_vars] that minimize (or maximize) the model within the list/range of the vars. Return -1 if the model has no optimum yet
+int   rtune_func_model_optimum(rtune_func_t * func, int maximize, double * x);
 void  rtune_func_set_update_schedule_attr(rtune_func_t * var, rtune_var_update_kind_t update_lt, rtune_var_update_kind_t update_policy, int update_iteration_start, int update_batch, int update_iteration_stride);
 
 //API for objectives, an objective is basically a flag to indicate whether a variable (var, func, model) meets certain criteria
@@ -414,8 +1071,26 @@ void rtune_objective_add_callback(rtune_objective_t obj, void *(*callback) (void
  */
 void rtune_objective_set_var_sample_attr(rtune_objective_t *obj, int sample_start_iteration, int num_samples, int sample_rate, int sample_stride); //start from the start_iteration, for every sample_rate+stride iterations, we pick one update of the variables. The update is for sample_rate iterations
 void rtune_objective_set_fidelity_attr(rtune_objective_t *obj, float deviation_tolerance, int fidelity_window, int lookup_window);
+//adaptive sample counts, see rtune_sampling_mode_t. confidence is the z of the interval, outlier_mads 0 disables the outlier rejection,
+//tolerance is absolute in the unit of the func values (RTUNE_SAMPLING_DEFAULT_TOLERANCE)
+void rtune_objective_set_sampling_attr(rtune_objective_t *obj, rtune_sampling_mode_t mode, double confidence, double outlier_mads, double tolerance, int max_samples);
 int  rtune_objective_is_met(rtune_objective_t *obj); //check whether objective is met or not */
 void rtune_objective_set_search_strategy(rtune_objective_t *obj, rtune_objective_search_strategy_t search_strategy);
+int  rtune_objective_get_num_explore_iterations(rtune_objective_t *obj); //number of iterations the objective has spent exploring
+//max number of evaluations of the search, the best config found so far is taken when it is spent. 0 (the default) is
+//RTUNE_SEARCH_DEFAULT_BUDGET, capped at the number of configs for SUCCESSIVE_HALVING and UCB over a small space.
+//exploration is the UCB exploration, ignored by the other strategies
+void rtune_objective_set_search_budget(rtune_objective_t *obj, int budget, double exploration);
+//keep a config per bucket of the values of context_var (e.g. an ext var of the problem size), see rtune_context_bucket_t.
+//num_buckets is at most RTUNE_CONTEXT_MAX_BUCKETS. Return -1 if the range or num_buckets is invalid
+int  rtune_objective_set_context(rtune_objective_t *obj, rtune_var_t *context_var, rtune_context_bucketing_t bucketing, double min, double max,
+                                 int num_buckets, int interpolate);
+void rtune_objective_set_cache_policy(rtune_objective_t *obj, rtune_cache_policy_t cache_policy);
+
+//open (create if it does not exist) the persistent tuning cache used by all the regions, or the one given by the RTUNE_CACHE environment
+//variable if path is NULL. Must be called before rtune_region_init. The converged configs are written to the cache when objectives are met.
+int  rtune_cache_open(const char * path);
+void rtune_cache_close(void);
 void rtune_objective_set_apply_policy(rtune_objective_t * obj,  rtune_var_apply_policy_t apply_policy); //set the apply policy for all the variables that are the input for the object func
 
 //API for callback, which is a function to be called when a var/obj/end is updated/evaluated, etc. TODO: need more scenario to show its usage
@@ -427,11 +1102,13 @@ void rtune_region_end_add_callback(rtune_region_t * region, void *(*callback) (v
 //High level API
 //For the best performance over OpenMP num_threads
 rtune_objective_t * rtune_objective_perf_numThreads(rtune_region_t * region, short min_num_threads, short max_num_threads, short step, int update_rate);
-//For the best energy efficiency over CPU frequency
+//For the best energy efficiency over CPU frequency. The energy and exec time are measured with the RTUNE_PROVIDER_ENERGY and RTUNE_PROVIDER_TSC providers
 rtune_objective_t * rtune_objective_energy_cpuFrequency(rtune_region_t * region, unsigned long min_freq, unsigned long max_freq, unsigned long step, int update_rate);
-//For the best edp (perf gradient * energy gradient over CPU frequency. By changing the CPU frequency, to get product of energy change and performance change
+//For the best edp (perf gradient * energy gradient over CPU frequency. By changing the CPU frequency, to get product of energy change and performance change.
+//Same providers as rtune_objective_energy_cpuFrequency
 rtune_objective_t * rtune_objective_edp_cpuFrequency(rtune_region_t * region, unsigned long min_freq, unsigned long max_freq, unsigned long step, int update_rate);
-//For weak scaling: overall performance(or per thread performance) over OpenMP num_threads and problem size
+//For weak scaling: overall performance(or per thread performance) over OpenMP num_threads and problem size. The problem size is the
+//context of the objective (rtune_objective_set_context), thus each range of sizes has its own num_threads
 rtune_objective_t * rtune_objective_weak_numThreads_size(rtune_region_t * region, unsigned long min_freq, unsigned long max_freq, unsigned long step, int update_rate);
 
 
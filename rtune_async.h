@@ -0,0 +1,123 @@
+#ifndef RTUNE_ASYNC_H
+#define RTUNE_ASYNC_H
+
+/**
+ * @brief kernels of the asynchronous mode: the bounded lock-free sample queue between the threads calling rtune_region_end
+ * and the worker, and the publication of configuration snapshots from the worker to rtune_regin_begin.
+ *
+ * The queue is the bounded MPMC queue of D. Vyukov: each slot has a sequence number that tells whether the slot is free
+ * for position pos (seq == pos) or holds the sample of position pos (seq == pos+1). Producers claim a position with a CAS
+ * on tail, and never wait for each other or for the worker. The GCC __atomic builtins are used so that the kernels work
+ * in both C and C++.
+ */
+#include <string.h>
+#include "rtune_api.h"
+
+//storage: slots of capacity entries and values of capacity*num_values entries. capacity must be a power of two
+static inline void rtune_async_queue_init(rtune_async_queue_t *q, unsigned int capacity, int num_values,
+                                          rtune_async_slot_t *slots, utype_t *values) {
+    q->tail = 0;
+    q->head = 0;
+    q->capacity = capacity;
+    q->mask = capacity - 1;
+    q->num_values = num_values;
+    q->slots = slots;
+    q->values = values;
+    q->num_dropped = 0;
+    for (unsigned int i = 0; i < capacity; i++) q->slots[i].seq = i;
+}
+
+static inline utype_t *rtune_async_slot_values(const rtune_async_queue_t *q, uint64_t pos) {
+    return q->values + (size_t) (pos & q->mask) * q->num_values;
+}
+
+/**
+ * publish a sample, called from rtune_region_end. Return 0 on success, or -1 if the queue is full, in which case the sample
+ * is dropped and counted in num_dropped, so the application thread never waits for the worker.
+ */
+static inline int rtune_async_push(rtune_async_queue_t *q, int iteration, int thread, uint64_t config_version, const utype_t *values) {
+    uint64_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    rtune_async_slot_t *slot;
+    for (;;) {
+        slot = &q->slots[pos & q->mask];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t dif = (int64_t) (seq - pos);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (dif < 0) {
+            __atomic_fetch_add(&q->num_dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        } else {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+    slot->iteration = iteration;
+    slot->thread = thread;
+    slot->config_version = config_version;
+    memcpy(rtune_async_slot_values(q, pos), values, sizeof(utype_t) * q->num_values);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * pop the oldest sample, called by the worker. Return 0 and copy the sample to *sample and values, or -1 if the queue is empty.
+ */
+static inline int rtune_async_pop(rtune_async_queue_t *q, rtune_async_slot_t *sample, utype_t *values) {
+    uint64_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    rtune_async_slot_t *slot;
+    for (;;) {
+        slot = &q->slots[pos & q->mask];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t dif = (int64_t) (seq - (pos + 1));
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (dif < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+    sample->iteration = slot->iteration;
+    sample->thread = slot->thread;
+    sample->config_version = slot->config_version;
+    memcpy(values, rtune_async_slot_values(q, pos), sizeof(utype_t) * q->num_values);
+    __atomic_store_n(&slot->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * publish the configuration index[num_vars] by writing it to the snapshot after *current in snapshots (ring of
+ * RTUNE_ASYNC_NUM_SNAPSHOTS) and storing the pointer to it in *current with release. Called by the worker only.
+ */
+static inline void rtune_config_publish(rtune_config_snapshot_t **current, rtune_config_snapshot_t *snapshots, const int *index, int num_vars) {
+    rtune_config_snapshot_t *cur = __atomic_load_n(current, __ATOMIC_RELAXED);
+    rtune_config_snapshot_t *next = cur ? &snapshots[(cur - snapshots + 1) % RTUNE_ASYNC_NUM_SNAPSHOTS] : &snapshots[0];
+    uint64_t version = cur ? cur->version + 2 : 2;
+    __atomic_store_n(&next->version, version - 1, __ATOMIC_RELAXED); //odd: being written
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (int i = 0; i < num_vars; i++) __atomic_store_n(&next->index[i], index[i], __ATOMIC_RELAXED);
+    __atomic_store_n(&next->version, version, __ATOMIC_RELEASE);
+    __atomic_store_n(current, next, __ATOMIC_RELEASE);
+}
+
+/**
+ * called from rtune_regin_begin. If the current snapshot is the one that was applied last (*applied_version), which is
+ * the common case, this is an acquire load of the pointer and a load of its version, and 0 is returned. Otherwise the
+ * configuration is copied to index, *applied_version is updated and 1 is returned, so that the caller applies the vars.
+ */
+static inline int rtune_config_read(rtune_config_snapshot_t *const *current, uint64_t *applied_version, int *index, int num_vars) {
+    for (;;) {
+        rtune_config_snapshot_t *snap = __atomic_load_n(current, __ATOMIC_ACQUIRE);
+        if (!snap) return 0;
+        uint64_t v1 = __atomic_load_n(&snap->version, __ATOMIC_ACQUIRE);
+        if (v1 == *applied_version) return 0;
+        if (v1 & 1) continue; //being rewritten, the worker has published 3 newer snapshots since we loaded the pointer
+        for (int i = 0; i < num_vars; i++) index[i] = __atomic_load_n(&snap->index[i], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&snap->version, __ATOMIC_RELAXED) != v1) continue;
+        *applied_version = v1;
+        return 1;
+    }
+}
+
+#endif
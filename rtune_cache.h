@@ -0,0 +1,231 @@
+#ifndef RTUNE_CACHE_H
+#define RTUNE_CACHE_H
+
+/**
+ * @brief kernels of the persistent tuning cache: the key of an objective, the hardware fingerprint, and the mapping,
+ * lookup and update of the cache file.
+ *
+ * Several jobs on the same machine can share a cache file. A writer claims an empty slot with a CAS on its key and
+ * brackets the update of the entry with seq, a reader copies the entry and retries if seq was odd or changed. The writers
+ * hold an exclusive flock on the file, which the kernel releases when a process dies, so an odd seq seen by a writer is
+ * left by a crashed writer and is reclaimed. A reader gives up after RTUNE_CACHE_SEQ_RETRIES and misses.
+ *
+ * ftruncate and flock are not C11: with -std=c11 compile with -D_DEFAULT_SOURCE (or -D_GNU_SOURCE).
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "rtune_api.h"
+#include "rtune_region.h" //rtune_data_type_size
+
+#define RTUNE_FNV_OFFSET 0xcbf29ce484222325ull
+#define RTUNE_FNV_PRIME 0x100000001b3ull
+
+static inline uint64_t rtune_hash64(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *) data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= RTUNE_FNV_PRIME;
+    }
+    return h;
+}
+
+static inline uint64_t rtune_hash64_str(uint64_t h, const char *s) {
+    return s ? rtune_hash64(h, s, strlen(s) + 1) : rtune_hash64(h, "", 1);
+}
+
+//CPU model name and number of CPUs
+static inline uint64_t rtune_cache_hw_fingerprint(void) {
+    uint64_t h = RTUNE_FNV_OFFSET;
+    char line[512];
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, "model name", 10) == 0) {
+                h = rtune_hash64_str(h, line);
+                break;
+            }
+        }
+        fclose(f);
+    }
+    long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+    return rtune_hash64(h, &ncpus, sizeof(ncpus));
+}
+
+//kind, type and values of a var. Only the bytes of the var type are hashed from utype_t
+static inline uint64_t rtune_cache_var_signature(uint64_t h, const rtune_var_t *var) {
+    size_t size = rtune_data_type_size(var->stvar.type);
+    h = rtune_hash64_str(h, var->stvar.name);
+    h = rtune_hash64(h, &var->kind, sizeof(var->kind));
+    h = rtune_hash64(h, &var->stvar.type, sizeof(var->stvar.type));
+    h = rtune_hash64(h, &var->num_unique_values, sizeof(var->num_unique_values));
+    if (var->kind == RTUNE_VAR_LIST && var->list_range_setting.list.list_values) {
+        h = rtune_hash64(h, var->list_range_setting.list.list_values, size * var->num_unique_values);
+    } else if (var->kind == RTUNE_VAR_RANGE) {
+        h = rtune_hash64(h, &var->list_range_setting.range.rangeBegin, size);
+        h = rtune_hash64(h, &var->list_range_setting.range.step, size);
+        h = rtune_hash64(h, &var->list_range_setting.range.rangeEnd, size);
+    }
+    return h;
+}
+
+static inline uint64_t rtune_cache_key(const rtune_cache_t *cache, const rtune_region_t *region, const rtune_objective_t *obj) {
+    uint64_t h = rtune_hash64_str(RTUNE_FNV_OFFSET, region->name);
+    h = rtune_hash64_str(h, obj->name);
+    h = rtune_hash64(h, &obj->kind, sizeof(obj->kind));
+    for (int i = 0; i < obj->num_vars; i++) h = rtune_cache_var_signature(h, obj->config[i].var);
+    h = rtune_hash64(h, &cache->hw_fingerprint, sizeof(cache->hw_fingerprint));
+    return h ? h : 1; //0 is an empty slot
+}
+
+static inline int rtune_cache_flock(int fd, int operation) {
+    int err;
+    do {
+        err = flock(fd, operation);
+    } while (err != 0 && errno == EINTR);
+    return err;
+}
+
+/**
+ * map the cache file, creating it with num_entries (rounded up to a power of two) entries if it is empty. Return 0 on success,
+ * -1 if it cannot be opened or mapped, or it is not a cache file of this version.
+ */
+static inline int rtune_cache_map(rtune_cache_t *cache, const char *path, uint32_t num_entries) {
+    uint32_t n = 1;
+    while (n < num_entries) n <<= 1;
+    cache->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (cache->fd < 0) return -1;
+
+    //the creation is serialized among processes, lookup is lock-free
+    if (rtune_cache_flock(cache->fd, LOCK_EX) != 0) {
+        close(cache->fd);
+        return -1;
+    }
+    struct stat st;
+    int err = fstat(cache->fd, &st);
+    int init = !err && st.st_size == 0;
+    if (init) {
+        err = ftruncate(cache->fd, (off_t) (sizeof(rtune_cache_header_t) + sizeof(rtune_cache_entry_t) * n));
+        if (!err) err = fstat(cache->fd, &st);
+    }
+    if (err || (size_t) st.st_size < sizeof(rtune_cache_header_t)) {
+        close(cache->fd); //releases the lock
+        return -1;
+    }
+    cache->size = st.st_size;
+    void *p = mmap(NULL, cache->size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    if (p == MAP_FAILED) {
+        close(cache->fd);
+        return -1;
+    }
+    cache->header = (rtune_cache_header_t *) p;
+    cache->entries = (rtune_cache_entry_t *) (cache->header + 1);
+    if (init) {
+        cache->header->version = RTUNE_CACHE_VERSION;
+        cache->header->entry_size = sizeof(rtune_cache_entry_t);
+        cache->header->num_entries = n;
+        __atomic_store_n(&cache->header->magic, RTUNE_CACHE_MAGIC, __ATOMIC_RELEASE);
+    }
+    err = rtune_cache_flock(cache->fd, LOCK_UN);
+
+    rtune_cache_header_t *h = cache->header;
+    if (err || h->magic != RTUNE_CACHE_MAGIC || h->version != RTUNE_CACHE_VERSION || h->entry_size != sizeof(rtune_cache_entry_t)
+        || (h->num_entries & (h->num_entries - 1)) != 0
+        || cache->size < sizeof(rtune_cache_header_t) + sizeof(rtune_cache_entry_t) * (size_t) h->num_entries) {
+        munmap(p, cache->size);
+        close(cache->fd);
+        return -1;
+    }
+    cache->hw_fingerprint = rtune_cache_hw_fingerprint();
+    cache->write_lock = 0;
+    return 0;
+}
+
+static inline void rtune_cache_unmap(rtune_cache_t *cache) {
+    munmap(cache->header, cache->size);
+    close(cache->fd);
+    cache->header = NULL;
+    cache->entries = NULL;
+}
+
+/**
+ * copy the entry of key to *entry and return 0, or return -1 if there is no entry for key, or if it is still being written
+ * after RTUNE_CACHE_SEQ_RETRIES reads (e.g. its writer crashed). No allocation.
+ */
+static inline int rtune_cache_lookup(const rtune_cache_t *cache, uint64_t key, rtune_cache_entry_t *entry) {
+    uint32_t mask = cache->header->num_entries - 1;
+    for (uint32_t i = 0; i <= mask; i++) {
+        rtune_cache_entry_t *e = &cache->entries[(key + i) & mask];
+        uint64_t k = __atomic_load_n(&e->key, __ATOMIC_ACQUIRE);
+        if (k == 0) return -1;
+        if (k != key) continue;
+        for (int retry = 0;; retry++) {
+            if (retry == RTUNE_CACHE_SEQ_RETRIES) return -1;
+            uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+            if (seq & 1) continue;
+            memcpy(entry, e, sizeof(*entry));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) == seq) break;
+        }
+        return entry->num_vars ? 0 : -1; //num_vars is 0 if the slot is claimed but not written yet
+    }
+    return -1;
+}
+
+static inline void rtune_cache_write_entry(rtune_cache_entry_t *e, const int *index, int num_vars, double value) {
+    //writers are serialized, thus an odd seq is left by a writer that crashed in the middle of the entry: it is reclaimed
+    uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_RELAXED) | 1u;
+    __atomic_store_n(&e->seq, seq, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (int v = 0; v < num_vars; v++) e->index[v] = index[v];
+    e->value = value;
+    e->updated = (uint64_t) time(NULL);
+    e->num_vars = (uint16_t) num_vars;
+    __atomic_store_n(&e->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * write the converged config of an objective. Return -1 if the table is full, num_vars is more than RTUNE_CACHE_MAX_VARS,
+ * or the file cannot be locked.
+ */
+static inline int rtune_cache_store(rtune_cache_t *cache, uint64_t key, const int *index, int num_vars, double value) {
+    if (num_vars > RTUNE_CACHE_MAX_VARS) return -1;
+    while (__atomic_exchange_n(&cache->write_lock, 1, __ATOMIC_ACQUIRE)) ;
+    if (rtune_cache_flock(cache->fd, LOCK_EX) != 0) {
+        __atomic_store_n(&cache->write_lock, 0, __ATOMIC_RELEASE);
+        return -1;
+    }
+    int err = -1;
+    uint32_t mask = cache->header->num_entries - 1;
+    for (uint32_t i = 0; i <= mask; i++) {
+        rtune_cache_entry_t *e = &cache->entries[(key + i) & mask];
+        uint64_t k = __atomic_load_n(&e->key, __ATOMIC_ACQUIRE);
+        if (k == 0) {
+            uint64_t zero = 0;
+            if (!__atomic_compare_exchange_n(&e->key, &zero, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) && zero != key) continue;
+        } else if (k != key) {
+            continue;
+        }
+        rtune_cache_write_entry(e, index, num_vars, value);
+        err = 0;
+        break;
+    }
+    if (rtune_cache_flock(cache->fd, LOCK_UN) != 0) err = -1;
+    __atomic_store_n(&cache->write_lock, 0, __ATOMIC_RELEASE);
+    return err;
+}
+
+//RTUNE_CACHE_VERIFY: whether the mean of the samples of the cached config is within deviation_tolerance (absolute, as for the
+//objective) of the cached value
+static inline int rtune_cache_verify(double sample_mean, double cached_value, float deviation_tolerance) {
+    double dev = sample_mean - cached_value;
+    return (dev < 0 ? -dev : dev) <= deviation_tolerance;
+}
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef RTUNE_CONTEXT_H
+#define RTUNE_CONTEXT_H
+
+/**
+ * @brief kernels of the context buckets of an objective: mapping the value of the context var to a bucket, swapping the
+ * per-bucket search state and config in and out of the objective, and interpolating the config of a new bucket.
+ *
+ * rtune_regin_begin calls rtune_context_update for each objective with a context var. When the context stays in the same
+ * bucket, which is the common case, this is the read of the var, one multiply (and a log2 for RTUNE_CONTEXT_LOG2) and a
+ * compare. The arrays of the NELDER_MEAD and SUCCESSIVE_HALVING/UCB search states are owned by the objective, which keeps
+ * them across buckets, and each bucket has its own copy, so a move to another bucket copies the arrays out and in.
+ */
+#include <math.h>
+#include <string.h>
+#include "rtune_api.h"
+#include "rtune_region.h"
+
+/**
+ * set up the buckets of obj. buckets has num_buckets entries and indices num_buckets*obj->num_vars entries, both allocated
+ * by the caller from the region arena. Return -1 if the range or num_buckets is invalid.
+ */
+static inline int rtune_context_setup(rtune_objective_t *obj, rtune_var_t *context_var, rtune_context_bucketing_t bucketing,
+                                      double min, double max, int num_buckets, int interpolate,
+                                      rtune_context_bucket_t *buckets, int *indices) {
+    if (num_buckets < 1 || num_buckets > RTUNE_CONTEXT_MAX_BUCKETS || !(max > min)) return -1;
+    if (bucketing == RTUNE_CONTEXT_LOG2) {
+        if (min <= 0.0) return -1;
+        min = log2(min);
+        max = log2(max);
+    }
+    obj->context_var = context_var;
+    obj->context_bucketing = bucketing;
+    obj->context_min = min;
+    obj->context_scale = num_buckets / (max - min);
+    obj->num_context_buckets = num_buckets;
+    obj->context_interpolate = interpolate;
+    obj->context_bucket = -1;
+    obj->context_buckets = buckets;
+    memset(buckets, 0, sizeof(rtune_context_bucket_t) * num_buckets);
+    for (int b = 0; b < num_buckets; b++) {
+        buckets[b].status = RTUNE_STATUS_CREATED;
+        buckets[b].index = indices + b * obj->num_vars;
+        buckets[b].best_candidate = -1;
+        buckets[b].value = NAN;
+    }
+    return 0;
+}
+
+static inline int rtune_context_bucket_of(const rtune_objective_t *obj, double x) {
+    if (obj->context_bucketing == RTUNE_CONTEXT_LOG2) x = x > 0.0 ? log2(x) : obj->context_min;
+    double pos = (x - obj->context_min) * obj->context_scale;
+    if (!(pos > 0.0)) return 0; //also NaN
+    return pos < obj->num_context_buckets ? (int) pos : obj->num_context_buckets - 1;
+}
+
+/**
+ * config of bucket b interpolated between the nearest met buckets on both sides, weighted by the distance in buckets.
+ * Return 0 and fill index[num_vars], or -1 if there is no met bucket on one of the sides.
+ */
+static inline int rtune_context_interpolate(const rtune_objective_t *obj, int b, int *index) {
+    const rtune_context_bucket_t *buckets = obj->context_buckets;
+    int lo = b - 1, hi = b + 1;
+    while (lo >= 0 && buckets[lo].status != RTUNE_STATUS_OBJECTIVE_MET) lo--;
+    while (hi < obj->num_context_buckets && buckets[hi].status != RTUNE_STATUS_OBJECTIVE_MET) hi++;
+    if (lo < 0 || hi >= obj->num_context_buckets) return -1;
+    double w = (double) (b - lo) / (double) (hi - lo);
+    for (int i = 0; i < obj->num_vars; i++) {
+        index[i] = (int) lround(buckets[lo].index[i] + w * (buckets[hi].index[i] - buckets[lo].index[i]));
+    }
+    return 0;
+}
+
+//config of the nearest met bucket, to seed the search of a new bucket. Return -1 if no bucket is met
+static inline int rtune_context_nearest(const rtune_objective_t *obj, int b, int *index) {
+    for (int d = 1; d < obj->num_context_buckets; d++) {
+        int c = b - d >= 0 && obj->context_buckets[b - d].status == RTUNE_STATUS_OBJECTIVE_MET ? b - d
+              : (b + d < obj->num_context_buckets && obj->context_buckets[b + d].status == RTUNE_STATUS_OBJECTIVE_MET ? b + d : -1);
+        if (c < 0) continue;
+        for (int i = 0; i < obj->num_vars; i++) index[i] = obj->context_buckets[c].index[i];
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * allocate the search arrays of every bucket of obj, sized as those of obj->search_state. Called when the search strategy
+ * is set on an objective with a context, or the context is set on an objective with a search strategy, after the arrays
+ * of the objective are allocated. Return 0, or -1 if out of memory.
+ */
+static inline int rtune_context_alloc_search(rtune_arena_t *arena, rtune_objective_t *obj) {
+    for (int b = 0; b < obj->num_context_buckets; b++) {
+        rtune_search_state_t *st = &obj->context_buckets[b].search_state;
+        memset(st, 0, sizeof(*st));
+        switch (obj->search_strategy) {
+            case RTUNE_OBJECTIVE_SEARCH_NELDER_MEAD: {
+                const rtune_search_simplex_t *o = &obj->search_state.simplex;
+                int n = o->n;
+                st->simplex.n = n;
+                st->simplex.num_values = o->num_values;
+                st->simplex.vertices = (int *) rtune_arena_alloc(arena, sizeof(int) * (size_t) ((n + 1) * n));
+                st->simplex.values = (double *) rtune_arena_alloc(arena, sizeof(double) * (size_t) (n + 1));
+                st->simplex.trial = (int *) rtune_arena_alloc(arena, sizeof(int) * (size_t) n);
+                st->simplex.reflect = (int *) rtune_arena_alloc(arena, sizeof(int) * (size_t) n);
+                if (!st->simplex.vertices || !st->simplex.values || !st->simplex.trial || !st->simplex.reflect) return -1;
+                break;
+            }
+            case RTUNE_OBJECTIVE_SEARCH_SUCCESSIVE_HALVING:
+            case RTUNE_OBJECTIVE_SEARCH_UCB: {
+                const rtune_search_bandit_t *o = &obj->search_state.bandit;
+                size_t m = (size_t) o->max_arms;
+                st->bandit.n = o->n;
+                st->bandit.num_values = o->num_values;
+                st->bandit.preference_right = o->preference_right;
+                st->bandit.count_value = o->count_value;
+                st->bandit.max_arms = o->max_arms;
+                st->bandit.arms = (int *) rtune_arena_alloc(arena, sizeof(int) * m * (size_t) o->n);
+                st->bandit.sum = (double *) rtune_arena_alloc(arena, sizeof(double) * m);
+                st->bandit.count = (long *) rtune_arena_alloc(arena, sizeof(long) * m);
+                st->bandit.alive = (int *) rtune_arena_alloc(arena, sizeof(int) * m);
+                if (!st->bandit.arms || !st->bandit.sum || !st->bandit.count || !st->bandit.alive) return -1;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return 0;
+}
+
+//copy the search state src into dst, whose arrays are kept: their contents are copied from those of src
+static inline void rtune_context_search_copy(rtune_objective_search_strategy_t strategy, rtune_search_state_t *dst,
+                                             const rtune_search_state_t *src) {
+    switch (strategy) {
+        case RTUNE_OBJECTIVE_SEARCH_NELDER_MEAD: {
+            rtune_search_simplex_t *d = &dst->simplex;
+            const rtune_search_simplex_t *s = &src->simplex;
+            int *vertices = d->vertices, *trial = d->trial, *reflect = d->reflect;
+            double *values = d->values;
+            int n = s->n;
+            if (vertices && s->vertices) {
+                memcpy(vertices, s->vertices, sizeof(int) * (size_t) ((n + 1) * n));
+                memcpy(values, s->values, sizeof(double) * (size_t) (n + 1));
+                memcpy(trial, s->trial, sizeof(int) * (size_t) n);
+                memcpy(reflect, s->reflect, sizeof(int) * (size_t) n);
+            }
+            *d = *s;
+            d->vertices = vertices;
+            d->values = values;
+            d->trial = trial;
+            d->reflect = reflect;
+            break;
+        }
+        case RTUNE_OBJECTIVE_SEARCH_SUCCESSIVE_HALVING:
+        case RTUNE_OBJECTIVE_SEARCH_UCB: {
+            rtune_search_bandit_t *d = &dst->bandit;
+            const rtune_search_bandit_t *s = &src->bandit;
+            int *arms = d->arms, *alive = d->alive;
+            double *sum = d->sum;
+            long *count = d->count;
+            if (arms && s->arms) {
+                memcpy(arms, s->arms, sizeof(int) * (size_t) s->num_arms * (size_t) s->n);
+                memcpy(sum, s->sum, sizeof(double) * (size_t) s->num_arms);
+                memcpy(count, s->count, sizeof(long) * (size_t) s->num_arms);
+                memcpy(alive, s->alive, sizeof(int) * (size_t) s->num_arms);
+            }
+            *d = *s;
+            d->arms = arms;
+            d->sum = sum;
+            d->count = count;
+            d->alive = alive;
+            break;
+        }
+        default:
+            *dst = *src;
+            break;
+    }
+}
+
+//reset the search state of a new bucket for the runtime to begin the search: the arrays and the sizes are kept, the rest is zeroed
+static inline void rtune_context_search_reset(rtune_objective_search_strategy_t strategy, rtune_search_state_t *st) {
+    rtune_search_state_t keep = *st;
+    memset(st, 0, sizeof(*st));
+    switch (strategy) {
+        case RTUNE_OBJECTIVE_SEARCH_NELDER_MEAD:
+            st->simplex.n = keep.simplex.n;
+            st->simplex.num_values = keep.simplex.num_values;
+            st->simplex.vertices = keep.simplex.vertices;
+            st->simplex.values = keep.simplex.values;
+            st->simplex.trial = keep.simplex.trial;
+            st->simplex.reflect = keep.simplex.reflect;
+            break;
+        case RTUNE_OBJECTIVE_SEARCH_SUCCESSIVE_HALVING:
+        case RTUNE_OBJECTIVE_SEARCH_UCB:
+            st->bandit.n = keep.bandit.n;
+            st->bandit.num_values = keep.bandit.num_values;
+            st->bandit.preference_right = keep.bandit.preference_right;
+            st->bandit.count_value = keep.bandit.count_value;
+            st->bandit.max_arms = keep.bandit.max_arms;
+            st->bandit.arms = keep.bandit.arms;
+            st->bandit.sum = keep.bandit.sum;
+            st->bandit.count = keep.bandit.count;
+            st->bandit.alive = keep.bandit.alive;
+            break;
+        default:
+            break;
+    }
+}
+
+static inline void rtune_context_save(rtune_objective_t *obj, rtune_context_bucket_t *bucket) {
+    for (int i = 0; i < obj->num_vars; i++) bucket->index[i] = obj->config[i].index;
+    bucket->status = obj->status == RTUNE_STATUS_OBJECTIVE_MET || obj->status == RTUNE_STATUS_OBJECTIVE_INACTION
+                     ? RTUNE_STATUS_OBJECTIVE_MET : RTUNE_STATUS_SAMPLING;
+    rtune_context_search_copy(obj->search_strategy, &bucket->search_state, &obj->search_state);
+    bucket->num_explore_iterations = obj->num_explore_iterations;
+    bucket->sample_stats = obj->sample_stats;
+    bucket->best_candidate = obj->best_candidate;
+}
+
+/**
+ * make bucket b the active bucket of obj. Return 1 if the runtime must begin a new search for the bucket, starting from
+ * config[].index: the config interpolated between the met buckets around b with interpolation, otherwise that of the
+ * nearest met bucket, if any. The interpolated config is not applied without sampling, as the bucket has no measured value.
+ * Return 0 if the objective continues the saved search of the bucket or is met with its config. sample_stats of a new bucket is NULL, the runtime allocates it if it needs it.
+ */
+static inline int rtune_context_enter(rtune_objective_t *obj, int b) {
+    if (obj->context_bucket >= 0) rtune_context_save(obj, &obj->context_buckets[obj->context_bucket]);
+    obj->context_bucket = b;
+    rtune_context_bucket_t *bucket = &obj->context_buckets[b];
+    if (bucket->status == RTUNE_STATUS_CREATED) {
+        int seeded = (obj->context_interpolate && rtune_context_interpolate(obj, b, bucket->index) == 0)
+                     || rtune_context_nearest(obj, b, bucket->index) == 0;
+        for (int i = 0; i < obj->num_vars; i++) obj->config[i].index = seeded ? bucket->index[i] : obj->config[i].index;
+        rtune_context_search_reset(obj->search_strategy, &obj->search_state);
+        obj->num_explore_iterations = 0;
+        obj->sample_stats = NULL;
+        obj->best_candidate = -1;
+        obj->status = RTUNE_STATUS_SAMPLING;
+        bucket->status = RTUNE_STATUS_SAMPLING;
+        return 1;
+    }
+    for (int i = 0; i < obj->num_vars; i++) obj->config[i].index = bucket->index[i];
+    rtune_context_search_copy(obj->search_strategy, &obj->search_state, &bucket->search_state);
+    obj->num_explore_iterations = bucket->num_explore_iterations;
+    obj->sample_stats = bucket->sample_stats;
+    obj->best_candidate = bucket->best_candidate;
+    obj->status = bucket->status;
+    return 0;
+}
+
+/**
+ * called from rtune_regin_begin. Return -1 if the context stays in the active bucket, otherwise the result of
+ * rtune_context_enter for the new bucket; in both cases config[].index of obj is the config to apply or to continue from.
+ */
+static inline int rtune_context_update(rtune_objective_t *obj) {
+    const stvar_t *ctx = &obj->context_var->stvar;
+    int b = rtune_context_bucket_of(obj, rtune_utype_to_double(ctx->type, ctx->v));
+    obj->context_buckets[b].num_hits++;
+    if (b == obj->context_bucket) return -1;
+    return rtune_context_enter(obj, b);
+}
+
+//when the objective is met in the active bucket, record the value of its config
+static inline void rtune_context_met(rtune_objective_t *obj, double value) {
+    rtune_context_bucket_t *bucket = &obj->context_buckets[obj->context_bucket];
+    bucket->value = value;
+    rtune_context_save(obj, bucket);
+}
+
+#endif
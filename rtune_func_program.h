@@ -0,0 +1,277 @@
+#ifndef RTUNE_FUNC_PROGRAM_H
+#define RTUNE_FUNC_PROGRAM_H
+
+/**
+ * @brief compilation of the func graph of a region into a rtune_func_program_t, and its evaluation over batches of states.
+ *
+ * The runtime loads the states of a batch into the registers of the vars (and of the ext funcs and models, whose values
+ * are provided rather than computed), marks them dirty, and evaluates the program. The coefficient vars of the linear funcs
+ * are not sampled, they are loaded with rtune_func_program_load_const, which only marks them dirty when their value has
+ * changed. Then the runtime pushes the registers of the funcs that were recomputed into their states.
+ * The program is allocated from the region arena and freed with the region.
+ */
+#include <math.h>
+#include <string.h>
+#include "rtune_api.h"
+#include "rtune_region.h"
+
+static inline double *rtune_func_program_reg(const rtune_func_program_t *prog, int reg) {
+    return prog->regs + (size_t) reg * prog->batch_capacity;
+}
+
+static inline void rtune_func_program_mark_dirty(rtune_func_program_t *prog, int reg) {
+    prog->dirty[reg >> 6] |= 1ull << (reg & 63);
+}
+
+static inline int rtune_func_program_is_dirty(const rtune_func_program_t *prog, int reg) {
+    return (prog->dirty[reg >> 6] >> (reg & 63)) & 1;
+}
+
+/**
+ * set all the states of the register of a var that is not sampled, e.g. a coefficient var, marking it dirty if the value
+ * differs from the last one loaded into the register. The first load of a register always marks it dirty.
+ */
+static inline void rtune_func_program_load_const(rtune_func_program_t *prog, int reg, double value) {
+    if (prog->consts[reg] == value) return;
+    prog->consts[reg] = value;
+    double *r = rtune_func_program_reg(prog, reg);
+    for (int k = 0; k < prog->batch_capacity; k++) r[k] = value;
+    rtune_func_program_mark_dirty(prog, reg);
+}
+
+static inline uint32_t rtune_func_reg_map_slot(const rtune_func_reg_map_t *map, const void *p) {
+    return (uint32_t) (((uint64_t) (uintptr_t) p * 0x9e3779b97f4a7c15ull) >> 32) & map->mask; //Fibonacci hashing
+}
+
+//register of a var or func of the region given its pointer, -1 if it is not in the region
+static inline int rtune_func_reg_map_find(const rtune_func_reg_map_t *map, const void *p) {
+    for (uint32_t s = rtune_func_reg_map_slot(map, p);; s = (s + 1) & map->mask) {
+        if (!map->keys[s]) return -1;
+        if (map->keys[s] == p) return map->regs[s];
+    }
+}
+
+//map the vars and funcs of the region to their registers, allocated from the region arena. Return -1 if out of memory
+static inline int rtune_func_reg_map_init(rtune_func_reg_map_t *map, rtune_region_t *region) {
+    int nv = region->num_vars, num_regs = nv + region->num_funcs;
+    uint32_t capacity = 2;
+    while (capacity < 2u * (uint32_t) num_regs) capacity <<= 1;
+    map->mask = capacity - 1;
+    map->keys = (const void **) rtune_arena_alloc(&region->arena, sizeof(void *) * capacity);
+    map->regs = (int *) rtune_arena_alloc(&region->arena, sizeof(int) * capacity);
+    if (!map->keys || !map->regs) return -1;
+    memset(map->keys, 0, sizeof(void *) * capacity);
+    for (int r = 0; r < num_regs; r++) {
+        const void *p = r < nv ? (const void *) region->vars[r] : (const void *) region->funcs[r - nv];
+        uint32_t s = rtune_func_reg_map_slot(map, p);
+        while (map->keys[s] && map->keys[s] != p) s = (s + 1) & map->mask;
+        if (map->keys[s]) continue; //the same pointer twice, the first register is kept
+        map->keys[s] = p;
+        map->regs[s] = r;
+    }
+    return 0;
+}
+
+//whether the func is computed by the program, i.e. it is not provided by the user or fitted
+static inline int rtune_func_is_computed(const rtune_func_t *func) {
+    switch (func->kind) {
+        case RTUNE_FUNC:
+        case RTUNE_FUNC_LOG:
+        case RTUNE_FUNC_ABS:
+        case RTUNE_FUNC_DIFF:
+        case RTUNE_FUNC_THRESHOLD:
+        case RTUNE_FUNC_DISTANCE:
+        case RTUNE_FUNC_GRADIENT:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static inline int rtune_func_num_inputs(const rtune_func_t *func) {
+    return func->kind == RTUNE_FUNC ? func->num_vars + func->num_coefficients : func->num_vars;
+}
+
+//number of instructions of a computed func
+static inline int rtune_func_num_insns(const rtune_func_t *func) {
+    return func->kind == RTUNE_FUNC ? 1 + func->num_vars : 1;
+}
+
+/**
+ * emit the instructions of a func. A linear RTUNE_FUNC is coef[0] + sum(coef[i+1] * var[i]) if it has num_vars+1 coefficients,
+ * or sum(coef[i] * var[i]) if it has num_vars coefficients; the coefficients are the coefficient vars that follow the input
+ * vars in input_varcoefs, read from their registers, so that a change of a coefficient is seen at the next evaluation.
+ */
+static inline int rtune_func_program_emit(const rtune_func_reg_map_t *map, const rtune_func_t *func, int dst, rtune_func_insn_t *insn) {
+    int src[2] = {0, 0};
+    for (int i = 0; i < 2 && i < func->num_vars; i++) {
+        src[i] = rtune_func_reg_map_find(map, func->input_varcoefs[i]);
+        if (src[i] < 0) return -1;
+    }
+    rtune_func_insn_t base = {0, (uint16_t) dst, (uint16_t) src[0], (uint16_t) src[1], 0.0};
+    switch (func->kind) {
+        case RTUNE_FUNC_LOG: base.op = RTUNE_FUNC_OP_LOG; break;
+        case RTUNE_FUNC_ABS: base.op = RTUNE_FUNC_OP_ABS; break;
+        case RTUNE_FUNC_DIFF:
+        case RTUNE_FUNC_DISTANCE: base.op = RTUNE_FUNC_OP_DIFF; break;
+        case RTUNE_FUNC_THRESHOLD: base.op = RTUNE_FUNC_OP_THRESHOLD; break;
+        case RTUNE_FUNC_GRADIENT: base.op = RTUNE_FUNC_OP_GRADIENT; break;
+        case RTUNE_FUNC: {
+            int n = func->num_vars;
+            int with_constant = func->num_coefficients == n + 1;
+            if (!with_constant && func->num_coefficients != n) return -1;
+            rtune_var_t *const *coef = func->input_varcoefs + n;
+            if (with_constant) {
+                int c = rtune_func_reg_map_find(map, coef[0]);
+                if (c < 0) return -1;
+                base.op = RTUNE_FUNC_OP_COPY;
+                base.src0 = (uint16_t) c;
+            } else {
+                base.op = RTUNE_FUNC_OP_CONST;
+            }
+            insn[0] = base;
+            for (int i = 0; i < n; i++) {
+                int s = rtune_func_reg_map_find(map, func->input_varcoefs[i]);
+                int c = rtune_func_reg_map_find(map, coef[i + with_constant]);
+                if (s < 0 || c < 0) return -1;
+                rtune_func_insn_t ma = {RTUNE_FUNC_OP_MUL_ADD, (uint16_t) dst, (uint16_t) s, (uint16_t) c, 0.0};
+                insn[1 + i] = ma;
+            }
+            return 1 + n;
+        }
+        default: return -1;
+    }
+    insn[0] = base;
+    return 1;
+}
+
+/**
+ * compile the computed funcs of the region in topological order: a func is emitted once all the funcs it uses are emitted.
+ * The program is allocated from the region arena. Return 0 on success, -1 if the graph has a cycle, an input is not in the
+ * region, the region has more than RTUNE_FUNC_MAX_REGS vars and funcs, or out of memory.
+ */
+static inline int rtune_func_program_compile(rtune_func_program_t *prog, rtune_region_t *region, int batch_capacity) {
+    int nv = region->num_vars, nf = region->num_funcs;
+    memset(prog, 0, sizeof(*prog));
+    if (nv + nf > RTUNE_FUNC_MAX_REGS || batch_capacity < 1) return -1;
+    prog->num_regs = nv + nf;
+    prog->batch_capacity = batch_capacity;
+    int max_insns = 0;
+    for (int j = 0; j < nf; j++) {
+        if (rtune_func_is_computed(region->funcs[j])) max_insns += rtune_func_num_insns(region->funcs[j]);
+    }
+    rtune_arena_t *a = &region->arena;
+    int num_dirty_words = (prog->num_regs + 63) / 64 + 1;
+    prog->insns = (rtune_func_insn_t *) rtune_arena_alloc(a, sizeof(rtune_func_insn_t) * (size_t) max_insns);
+    prog->group_begin = (int *) rtune_arena_alloc(a, sizeof(int) * (size_t) (nf + 1));
+    prog->regs = (double *) rtune_arena_alloc(a, sizeof(double) * (size_t) prog->num_regs * (size_t) batch_capacity);
+    prog->prev = (double *) rtune_arena_alloc(a, sizeof(double) * (size_t) prog->num_regs);
+    prog->consts = (double *) rtune_arena_alloc(a, sizeof(double) * (size_t) prog->num_regs);
+    prog->dirty = (uint64_t *) rtune_arena_alloc(a, sizeof(uint64_t) * (size_t) num_dirty_words);
+    char *emitted = (char *) rtune_arena_alloc(a, (size_t) nf);
+    rtune_func_reg_map_t map;
+    if ((max_insns && !prog->insns) || !prog->group_begin || (prog->num_regs && (!prog->regs || !prog->prev || !prog->consts))
+        || !prog->dirty || (nf && !emitted) || rtune_func_reg_map_init(&map, region) != 0) {
+        memset(prog, 0, sizeof(*prog));
+        return -1;
+    }
+    for (int r = 0; r < prog->num_regs; r++) prog->prev[r] = prog->consts[r] = NAN;
+    for (int j = 0; j < nf; j++) emitted[j] = !rtune_func_is_computed(region->funcs[j]); //provided funcs are ready
+
+    int num_emitted = 0, num_computed = 0;
+    for (int j = 0; j < nf; j++) num_computed += !emitted[j];
+    while (num_emitted < num_computed) {
+        int progress = 0;
+        for (int j = 0; j < nf; j++) {
+            if (emitted[j]) continue;
+            const rtune_func_t *func = region->funcs[j];
+            int ready = 1;
+            for (int i = 0; i < rtune_func_num_inputs(func) && ready; i++) {
+                int reg = rtune_func_reg_map_find(&map, func->input_varcoefs[i]);
+                if (reg < 0) ready = -1;
+                else if (reg >= nv && !emitted[reg - nv]) ready = 0;
+            }
+            if (ready < 0) break;
+            if (!ready) continue;
+            prog->group_begin[prog->num_groups++] = prog->num_insns;
+            int n = rtune_func_program_emit(&map, func, nv + j, prog->insns + prog->num_insns);
+            if (n < 0) break;
+            prog->num_insns += n;
+            emitted[j] = 1;
+            num_emitted++;
+            progress = 1;
+        }
+        if (!progress) break;
+    }
+    if (num_emitted < num_computed) {
+        memset(prog, 0, sizeof(*prog)); //the memory stays in the arena until the region is freed
+        return -1;
+    }
+    prog->group_begin[prog->num_groups] = prog->num_insns;
+    return 0;
+}
+
+static inline void rtune_func_program_exec(rtune_func_program_t *prog, const rtune_func_insn_t *insn, int n) {
+    double *d = rtune_func_program_reg(prog, insn->dst);
+    const double *a = rtune_func_program_reg(prog, insn->src0);
+    const double *b = rtune_func_program_reg(prog, insn->src1);
+    double imm = insn->imm;
+    switch ((rtune_func_op_t) insn->op) {
+        case RTUNE_FUNC_OP_LOG: for (int k = 0; k < n; k++) d[k] = log(a[k]); break;
+        case RTUNE_FUNC_OP_ABS: for (int k = 0; k < n; k++) d[k] = fabs(a[k]); break;
+        case RTUNE_FUNC_OP_DIFF: for (int k = 0; k < n; k++) d[k] = a[k] - b[k]; break;
+        case RTUNE_FUNC_OP_THRESHOLD: for (int k = 0; k < n; k++) d[k] = a[k] < b[k] ? 0.0 : 1.0; break;
+        case RTUNE_FUNC_OP_GRADIENT: {
+            double prev = prog->prev[insn->src0];
+            if (n > 0) d[0] = isnan(prev) ? 0.0 : a[0] - prev; //the first state has no previous one, its gradient is 0
+            for (int k = 1; k < n; k++) d[k] = a[k] - a[k-1];
+            break;
+        }
+        case RTUNE_FUNC_OP_CONST: for (int k = 0; k < n; k++) d[k] = imm; break;
+        case RTUNE_FUNC_OP_MUL_ADD: for (int k = 0; k < n; k++) d[k] += a[k] * b[k]; break;
+        case RTUNE_FUNC_OP_COPY: for (int k = 0; k < n; k++) d[k] = a[k]; break;
+    }
+}
+
+/**
+ * evaluate the funcs over the batch_size states in the registers. A group is only executed if one of its inputs is dirty,
+ * and then its func register becomes dirty, so the funcs that use it are executed too. On return, the dirty bits tell which
+ * funcs were recomputed; the caller clears them with rtune_func_program_end_batch after pushing the states.
+ */
+static inline void rtune_func_program_eval(rtune_func_program_t *prog) {
+    int n = prog->batch_size;
+    for (int g = 0; g < prog->num_groups; g++) {
+        int begin = prog->group_begin[g], end = prog->group_begin[g + 1];
+        int dirty = 0;
+        for (int i = begin; i < end && !dirty; i++) {
+            const rtune_func_insn_t *insn = &prog->insns[i];
+            switch ((rtune_func_op_t) insn->op) {
+                case RTUNE_FUNC_OP_CONST: break;
+                case RTUNE_FUNC_OP_DIFF:
+                case RTUNE_FUNC_OP_THRESHOLD:
+                case RTUNE_FUNC_OP_MUL_ADD:
+                    dirty = rtune_func_program_is_dirty(prog, insn->src0) || rtune_func_program_is_dirty(prog, insn->src1);
+                    break;
+                default:
+                    dirty = rtune_func_program_is_dirty(prog, insn->src0);
+                    break;
+            }
+        }
+        if (!dirty) continue;
+        for (int i = begin; i < end; i++) rtune_func_program_exec(prog, &prog->insns[i], n);
+        rtune_func_program_mark_dirty(prog, prog->insns[begin].dst);
+    }
+}
+
+//remember the last state of each dirty register for GRADIENT, and clear the dirty bits
+static inline void rtune_func_program_end_batch(rtune_func_program_t *prog) {
+    int n = prog->batch_size;
+    if (n > 0) {
+        for (int r = 0; r < prog->num_regs; r++) {
+            if (rtune_func_program_is_dirty(prog, r)) prog->prev[r] = rtune_func_program_reg(prog, r)[n - 1];
+        }
+    }
+    memset(prog->dirty, 0, sizeof(uint64_t) * ((prog->num_regs + 63) / 64 + 1));
+}
+
+#endif
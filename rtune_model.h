@@ -0,0 +1,189 @@
+#ifndef RTUNE_MODEL_H
+#define RTUNE_MODEL_H
+
+/**
+ * @brief recursive least squares kernels of the RTUNE_MODEL_LINEAR and RTUNE_MODEL_QUADRATIC funcs.
+ *
+ * The update is the standard RLS with forgetting factor lambda:
+ *     k = P*phi / (lambda + phi'*P*phi),  theta += k * (y - theta'*phi),  P = (P - k*(P*phi)') / lambda
+ * which is O(p^2) per sample. The loops are over contiguous arrays without branches, so that the compiler vectorizes them.
+ */
+#include <math.h>
+#include "rtune_api.h"
+
+#define RTUNE_MODEL_INIT_P 1e6 //initial P = RTUNE_MODEL_INIT_P * I, i.e. a weak prior of theta = 0
+#define RTUNE_MODEL_MAX_VARS 16 //the number of features of a quadratic model grows with n^2, and the optimum may be searched over 2^n corners
+#define RTUNE_MODEL_MAX_FEATURES (1 + RTUNE_MODEL_MAX_VARS + RTUNE_MODEL_MAX_VARS * (RTUNE_MODEL_MAX_VARS + 1) / 2)
+
+static inline int rtune_model_num_features(rtune_kind_t kind, int n) {
+    return kind == RTUNE_MODEL_QUADRATIC ? 1 + n + n * (n + 1) / 2 : 1 + n;
+}
+
+//the arrays of m must be allocated for the kind and n. lo/hi are the min/max values of each var. Return -1 if n > RTUNE_MODEL_MAX_VARS
+static inline int rtune_model_init(rtune_model_rls_t *m, rtune_kind_t kind, int n, const double *lo, const double *hi,
+                                    double forgetting, double confidence) {
+    if (n > RTUNE_MODEL_MAX_VARS) return -1;
+    m->kind = kind;
+    m->n = n;
+    m->p = rtune_model_num_features(kind, n);
+    m->lambda = forgetting;
+    m->confidence = confidence;
+    m->sse = 0.0;
+    m->num_samples = 0;
+    for (int i = 0; i < n; i++) {
+        m->center[i] = 0.5 * (lo[i] + hi[i]);
+        m->half_range[i] = hi[i] > lo[i] ? 0.5 * (hi[i] - lo[i]) : 1.0;
+    }
+    for (int i = 0; i < m->p; i++) {
+        m->theta[i] = 0.0;
+        for (int j = 0; j < m->p; j++) m->P[i * m->p + j] = i == j ? RTUNE_MODEL_INIT_P : 0.0;
+    }
+    return 0;
+}
+
+//features of the normalized values z
+static inline void rtune_model_features_z(const rtune_model_rls_t *m, const double *z, double *phi) {
+    int n = m->n;
+    phi[0] = 1.0;
+    for (int i = 0; i < n; i++) phi[1 + i] = z[i];
+    if (m->kind != RTUNE_MODEL_QUADRATIC) return;
+    int k = 1 + n;
+    for (int i = 0; i < n; i++) {
+        for (int j = i; j < n; j++) phi[k++] = z[i] * z[j];
+    }
+}
+
+static inline void rtune_model_normalize(const rtune_model_rls_t *m, const double *x, double *z) {
+    for (int i = 0; i < m->n; i++) z[i] = (x[i] - m->center[i]) / m->half_range[i];
+}
+
+static inline double rtune_model_dot(const double *a, const double *b, int p) {
+    double s = 0.0;
+    for (int i = 0; i < p; i++) s += a[i] * b[i];
+    return s;
+}
+
+//add a sample y of the func at var values x[n]
+static inline void rtune_model_update(rtune_model_rls_t *m, const double *x, double y) {
+    int p = m->p;
+    double *P = m->P, *phi = m->phi, *Pphi = m->Pphi;
+    double z[RTUNE_MODEL_MAX_VARS];
+    rtune_model_normalize(m, x, z);
+    rtune_model_features_z(m, z, phi);
+    for (int i = 0; i < p; i++) Pphi[i] = rtune_model_dot(&P[i * p], phi, p);
+    double denom = m->lambda + rtune_model_dot(phi, Pphi, p);
+    double err = y - rtune_model_dot(m->theta, phi, p);
+    double g = err / denom;
+    for (int i = 0; i < p; i++) m->theta[i] += g * Pphi[i];
+    //P is symmetric, thus (P*phi)' = phi'*P. The upper triangle is updated and mirrored: the rounding errors would otherwise
+    //make P asymmetric, and the asymmetric part grows by 1/lambda per sample with forgetting
+    double inv_lambda = 1.0 / m->lambda;
+    for (int i = 0; i < p; i++) {
+        double ki = Pphi[i] / denom;
+        double *row = &P[i * p];
+        for (int j = i; j < p; j++) row[j] = (row[j] - ki * Pphi[j]) * inv_lambda;
+        for (int j = i + 1; j < p; j++) P[j * p + i] = row[j];
+    }
+    m->sse = m->lambda * m->sse + err * err / (1.0 + rtune_model_dot(phi, Pphi, p) / m->lambda);
+    m->num_samples++;
+}
+
+//the features are in a local array, m is only read so that several threads can predict with the same model
+static inline double rtune_model_eval_z(const rtune_model_rls_t *m, const double *z, double *stddev) {
+    double phi[RTUNE_MODEL_MAX_FEATURES];
+    rtune_model_features_z(m, z, phi);
+    double value = rtune_model_dot(m->theta, phi, m->p);
+    if (stddev) {
+        int p = m->p;
+        double v = 0.0;
+        for (int i = 0; i < p; i++) v += phi[i] * rtune_model_dot(&m->P[i * p], phi, p);
+        long dof = m->num_samples - p;
+        double sigma2 = m->sse / (double) (dof > 0 ? dof : 1);
+        *stddev = sqrt(sigma2 * (v > 0.0 ? v : 0.0));
+    }
+    return value;
+}
+
+//value and its stddev at var values x[n]. Return -1 if there are fewer samples than parameters
+static inline int rtune_model_predict(const rtune_model_rls_t *m, const double *x, double *value, double *stddev) {
+    if (m->num_samples < m->p) return -1;
+    double z[RTUNE_MODEL_MAX_VARS];
+    rtune_model_normalize(m, x, z);
+    *value = rtune_model_eval_z(m, z, stddev);
+    return 0;
+}
+
+//best of the corners of [-1,1]^n, used when the model is linear or the quadratic is not convex in the optimization direction
+static inline void rtune_model_best_corner(const rtune_model_rls_t *m, int maximize, double *z) {
+    int n = m->n;
+    double c[RTUNE_MODEL_MAX_VARS];
+    double best = 0.0;
+    for (unsigned long mask = 0; mask < (1ul << n); mask++) {
+        for (int i = 0; i < n; i++) c[i] = (mask >> i) & 1 ? 1.0 : -1.0;
+        double v = rtune_model_eval_z(m, c, NULL);
+        if (mask == 0 || (maximize ? v > best : v < best)) {
+            best = v;
+            for (int i = 0; i < n; i++) z[i] = c[i];
+        }
+    }
+}
+
+/**
+ * var values x[n] of the optimum within the list/range of the vars. For a convex (concave if maximize) quadratic model,
+ * the stationary point is solved by Gaussian elimination and clamped to the box, which is exact when the stationary point
+ * is inside the box; otherwise the best corner is taken.
+ * Return -1 if there are fewer samples than parameters.
+ */
+static inline int rtune_model_optimum(rtune_model_rls_t *m, int maximize, double *x) {
+    int n = m->n;
+    if (m->num_samples < m->p) return -1;
+    double z[RTUNE_MODEL_MAX_VARS];
+    int solved = 0;
+    if (m->kind == RTUNE_MODEL_QUADRATIC) {
+        //gradient: b_k + sum_j H_kj z_j = 0, H_kk = 2 q_kk, H_kj = q_kj. sign flips the problem to a minimization
+        double sign = maximize ? -1.0 : 1.0;
+        double *a = m->work; //[n][n+1]
+        const double *b = m->theta + 1, *q = m->theta + 1 + n;
+        int k = 0;
+        for (int i = 0; i < n; i++) {
+            for (int j = i; j < n; j++, k++) {
+                a[i * (n + 1) + j] = sign * (i == j ? 2.0 * q[k] : q[k]);
+                a[j * (n + 1) + i] = a[i * (n + 1) + j];
+            }
+            a[i * (n + 1) + n] = -sign * b[i];
+        }
+        //elimination without pivoting, a non-positive pivot means the quadratic is not convex
+        solved = 1;
+        for (int i = 0; i < n && solved; i++) {
+            double pivot = a[i * (n + 1) + i];
+            if (pivot <= 1e-12) {
+                solved = 0;
+                break;
+            }
+            for (int r = i + 1; r < n; r++) {
+                double f = a[r * (n + 1) + i] / pivot;
+                for (int c = i; c <= n; c++) a[r * (n + 1) + c] -= f * a[i * (n + 1) + c];
+            }
+        }
+        if (solved) {
+            for (int i = n - 1; i >= 0; i--) {
+                double s = a[i * (n + 1) + n];
+                for (int c = i + 1; c < n; c++) s -= a[i * (n + 1) + c] * z[c];
+                z[i] = s / a[i * (n + 1) + i];
+            }
+            for (int i = 0; i < n; i++) z[i] = z[i] < -1.0 ? -1.0 : (z[i] > 1.0 ? 1.0 : z[i]);
+        }
+    }
+    if (!solved) rtune_model_best_corner(m, maximize, z);
+    for (int i = 0; i < n; i++) x[i] = m->center[i] + z[i] * m->half_range[i];
+    return 0;
+}
+
+//whether the model is confident enough at its optimum x to stop sampling, i.e. the func can be RTUNE_STATUS_MODELED
+static inline int rtune_model_is_confident(rtune_model_rls_t *m, const double *x) {
+    double value, stddev;
+    if (m->confidence <= 0.0 || rtune_model_predict(m, x, &value, &stddev) != 0) return 0;
+    return stddev <= m->confidence;
+}
+
+#endif
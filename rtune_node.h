@@ -0,0 +1,199 @@
+#ifndef RTUNE_NODE_H
+#define RTUNE_NODE_H
+
+/**
+ * @brief kernels of the node-local coordination of the _sync region calls: attaching the shared memory segment of a region,
+ * the futex barrier, the split of the configurations among the ranks, the pooling of samples and the agreement on the winner.
+ *
+ * Everything is in the shared segment and is updated with the GCC __atomic builtins, so the ranks can be any processes on
+ * the node, e.g. MPI ranks or plain forked processes. Linux only (futex).
+ *
+ * ftruncate, kill, nanosleep and syscall are not C11: with -std=c11 compile with -D_DEFAULT_SOURCE (or -D_GNU_SOURCE).
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "rtune_api.h"
+
+#define RTUNE_NODE_BARRIER_SPINS 4096 //spin this many times before sleeping in the futex
+
+static inline size_t rtune_node_shared_size(int num_configs) {
+    return sizeof(rtune_node_shared_t) + sizeof(rtune_node_stat_t) * (size_t) num_configs;
+}
+
+//the pooled samples of the configurations, right after the header (whose size is a multiple of the cache line)
+static inline rtune_node_stat_t *rtune_node_stats(const rtune_node_shared_t *shared) {
+    return (rtune_node_stat_t *) (shared + 1);
+}
+
+static inline void rtune_node_shm_name(char *name, size_t size, const char *shm_prefix, int region_id) {
+    snprintf(name, size, "/%s.%d", shm_prefix[0] == '/' ? shm_prefix + 1 : shm_prefix, region_id);
+}
+
+static inline int rtune_node_pid_alive(int pid) {
+    return pid > 0 && (kill((pid_t) pid, 0) == 0 || errno == EPERM);
+}
+
+//rank 0: remove the segment of a crashed job if any, and create a new zero-filled one
+static inline rtune_node_shared_t *rtune_node_create(const char *name, int num_ranks, int num_configs) {
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) return NULL;
+    size_t size = rtune_node_shared_size(num_configs);
+    rtune_node_shared_t *shared = (rtune_node_shared_t *) MAP_FAILED;
+    if (ftruncate(fd, (off_t) size) == 0) shared = (rtune_node_shared_t *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        shm_unlink(name);
+        return NULL;
+    }
+    shared->num_ranks = (uint32_t) num_ranks;
+    shared->num_configs = (uint32_t) num_configs;
+    shared->creator_pid = (int32_t) getpid();
+    __atomic_store_n(&shared->magic, RTUNE_NODE_MAGIC, __ATOMIC_RELEASE);
+    return shared;
+}
+
+/**
+ * the other ranks: attach the segment once rank 0 has set it up. A segment that does not have the size of num_configs yet
+ * (being created, or left by a crashed job) or whose creator is gone is not attached, and is retried every millisecond.
+ * The segment is never resized by these ranks.
+ */
+static inline rtune_node_shared_t *rtune_node_open(const char *name, int num_ranks, int num_configs) {
+    size_t size = rtune_node_shared_size(num_configs);
+    const struct timespec ms = {0, 1000000};
+    for (int waited = 0; waited < RTUNE_NODE_ATTACH_TIMEOUT_MS; waited++, nanosleep(&ms, NULL)) {
+        int fd = shm_open(name, O_RDWR, 0600);
+        if (fd < 0) continue;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t) st.st_size != size) {
+            close(fd);
+            continue;
+        }
+        rtune_node_shared_t *shared = (rtune_node_shared_t *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (shared == MAP_FAILED) return NULL;
+        if (__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) == RTUNE_NODE_MAGIC && rtune_node_pid_alive(shared->creator_pid)) {
+            if (shared->num_ranks == (uint32_t) num_ranks && shared->num_configs == (uint32_t) num_configs) return shared;
+            munmap(shared, size);
+            return NULL;
+        }
+        munmap(shared, size);
+    }
+    return NULL;
+}
+
+/**
+ * create (rank 0) or attach (the other ranks) the segment of a region. All the local ranks call it with the same arguments
+ * but their rank, in any order. Return NULL if the segment cannot be created or mapped, if it does not match
+ * num_ranks/num_configs, or if rank 0 has not created it within RTUNE_NODE_ATTACH_TIMEOUT_MS.
+ */
+static inline rtune_node_shared_t *rtune_node_attach(const char *shm_prefix, int region_id, int rank, int num_ranks, int num_configs) {
+    char name[256];
+    rtune_node_shm_name(name, sizeof(name), shm_prefix, region_id);
+    rtune_node_shared_t *shared = rank == 0 ? rtune_node_create(name, num_ranks, num_configs) : rtune_node_open(name, num_ranks, num_configs);
+    if (shared) __atomic_fetch_add(&shared->attached, 1, __ATOMIC_ACQ_REL);
+    return shared;
+}
+
+//unmap the segment. The last rank to detach removes it
+static inline void rtune_node_detach(rtune_node_shared_t *shared, const char *shm_prefix, int region_id) {
+    size_t size = rtune_node_shared_size((int) shared->num_configs);
+    int last = __atomic_sub_fetch(&shared->attached, 1, __ATOMIC_ACQ_REL) == 0;
+    munmap(shared, size);
+    if (last) {
+        char name[256];
+        rtune_node_shm_name(name, sizeof(name), shm_prefix, region_id);
+        shm_unlink(name);
+    }
+}
+
+static inline void rtune_node_barrier_wait(rtune_node_barrier_t *b, uint32_t num_ranks) {
+    uint32_t gen = __atomic_load_n(&b->generation, __ATOMIC_ACQUIRE);
+    if (__atomic_add_fetch(&b->count, 1, __ATOMIC_ACQ_REL) == num_ranks) {
+        __atomic_store_n(&b->count, 0, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&b->generation, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &b->generation, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+        return;
+    }
+    for (int i = 0; i < RTUNE_NODE_BARRIER_SPINS; i++) {
+        if (__atomic_load_n(&b->generation, __ATOMIC_ACQUIRE) != gen) return;
+    }
+    while (__atomic_load_n(&b->generation, __ATOMIC_ACQUIRE) == gen) {
+        syscall(SYS_futex, &b->generation, FUTEX_WAIT, gen, NULL, NULL, 0);
+    }
+}
+
+//whether the configuration is explored by the rank
+static inline int rtune_node_owns(int config, int rank, int num_ranks) {
+    return config % num_ranks == rank;
+}
+
+//the ith configuration explored by the rank, -1 if the rank has no ith configuration
+static inline int rtune_node_config_of(const rtune_node_shared_t *shared, int rank, int i) {
+    long c = (long) i * shared->num_ranks + rank;
+    return c < (long) shared->num_configs ? (int) c : -1;
+}
+
+//add a sample of a configuration to the pooled table
+static inline void rtune_node_stat_add(rtune_node_shared_t *shared, int config, double value) {
+    rtune_node_stat_t *st = &rtune_node_stats(shared)[config];
+    double old, sum;
+    __atomic_load(&st->sum, &old, __ATOMIC_RELAXED);
+    do {
+        sum = old + value;
+    } while (!__atomic_compare_exchange(&st->sum, &old, &sum, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    __atomic_fetch_add(&st->count, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * agree on the winning configuration, i.e. the one with the min (or max if maximize) mean of the pooled samples. Called by
+ * all the ranks once they have sampled their configurations. Rank 0 picks the winner between two barriers, thus all
+ * the ranks return the same configuration. Return -1 if no configuration has a sample.
+ */
+static inline int rtune_node_agree(rtune_node_shared_t *shared, int rank, int maximize) {
+    rtune_node_barrier_wait(&shared->barrier, shared->num_ranks);
+    if (rank == 0) {
+        int winner = -1;
+        double best = 0.0;
+        const rtune_node_stat_t *stats = rtune_node_stats(shared);
+        for (uint32_t c = 0; c < shared->num_configs; c++) {
+            uint64_t n = __atomic_load_n(&stats[c].count, __ATOMIC_ACQUIRE);
+            if (n == 0) continue;
+            double mean = stats[c].sum / (double) n;
+            if (winner < 0 || (maximize ? mean > best : mean < best)) {
+                winner = (int) c;
+                best = mean;
+            }
+        }
+        __atomic_store_n(&shared->winner_plus_one, winner + 1, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&shared->round, 1, __ATOMIC_RELAXED);
+    }
+    rtune_node_barrier_wait(&shared->barrier, shared->num_ranks);
+    return __atomic_load_n(&shared->winner_plus_one, __ATOMIC_ACQUIRE) - 1;
+}
+
+/**
+ * start a new tuning round, e.g. when the region retunes. Called by all the ranks before they sample again: the pooled
+ * samples and the winner of the previous round are cleared by rank 0 between two barriers, so no sample of the new round
+ * is added before the reset.
+ */
+static inline void rtune_node_round_begin(rtune_node_shared_t *shared, int rank) {
+    rtune_node_barrier_wait(&shared->barrier, shared->num_ranks);
+    if (rank == 0) {
+        memset(rtune_node_stats(shared), 0, sizeof(rtune_node_stat_t) * shared->num_configs);
+        __atomic_store_n(&shared->winner_plus_one, 0, __ATOMIC_RELEASE);
+    }
+    rtune_node_barrier_wait(&shared->barrier, shared->num_ranks);
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef RTUNE_PROFILE_H
+#define RTUNE_PROFILE_H
+
+/**
+ * @brief self-profiling kernels: recording of latencies into the log2-bucketed histograms of rtune_profile_t, and
+ * merging, quantiles and printing of the histograms. The timestamps are taken with the TSC timer of rtune_provider.h.
+ *
+ * The runtime wraps a probe with RTUNE_PROFILE_START/RTUNE_PROFILE_STOP, which compile to nothing unless RTUNE_PROFILE
+ * is defined, and do nothing at run time if profile is NULL (profiling is not enabled).
+ */
+#include <stdio.h>
+#include "rtune_api.h"
+#include "rtune_provider.h"
+
+static inline int rtune_profile_bucket(uint64_t ns) {
+    if (ns == 0) return 0;
+    int b = 63 - __builtin_clzll(ns);
+    return b < RTUNE_PROFILE_NUM_BUCKETS ? b : RTUNE_PROFILE_NUM_BUCKETS - 1;
+}
+
+static inline uint64_t rtune_profile_now_ns(const rtune_tsc_timer_t *timer) {
+    return (uint64_t) (rtune_tsc_ticks(timer) * timer->seconds_per_tick * 1e9);
+}
+
+static inline void rtune_profile_record(rtune_profile_hist_t *hist, uint64_t ns) {
+    hist->buckets[rtune_profile_bucket(ns)]++;
+    if (hist->count == 0 || ns < hist->min_ns) hist->min_ns = ns;
+    if (ns > hist->max_ns) hist->max_ns = ns;
+    hist->count++;
+    hist->sum_ns += ns;
+}
+
+static inline void rtune_profile_merge(rtune_profile_hist_t *dst, const rtune_profile_hist_t *src) {
+    if (src->count == 0) return;
+    for (int i = 0; i < RTUNE_PROFILE_NUM_BUCKETS; i++) dst->buckets[i] += src->buckets[i];
+    if (dst->count == 0 || src->min_ns < dst->min_ns) dst->min_ns = src->min_ns;
+    if (src->max_ns > dst->max_ns) dst->max_ns = src->max_ns;
+    dst->count += src->count;
+    dst->sum_ns += src->sum_ns;
+}
+
+//upper bound of the bucket that contains quantile q (0..1) of the latencies, capped by max_ns
+static inline uint64_t rtune_profile_quantile(const rtune_profile_hist_t *hist, double q) {
+    if (hist->count == 0) return 0;
+    uint64_t rank = (uint64_t) (q * (double) (hist->count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < RTUNE_PROFILE_NUM_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint64_t upper = (2ull << i) - 1;
+            return upper < hist->max_ns ? upper : hist->max_ns;
+        }
+    }
+    return hist->max_ns;
+}
+
+//time spent in begin and end as a fraction of the time of the region body
+static inline double rtune_profile_overhead(const rtune_profile_t *profile) {
+    uint64_t body = profile->hist[RTUNE_PROFILE_REGION_BODY].sum_ns;
+    uint64_t rtune = profile->hist[RTUNE_PROFILE_REGION_BEGIN].sum_ns + profile->hist[RTUNE_PROFILE_REGION_END].sum_ns;
+    return body ? (double) rtune / (double) body : 0.0;
+}
+
+static inline const char *rtune_profile_probe_name(rtune_profile_probe_t probe) {
+    switch (probe) {
+        case RTUNE_PROFILE_REGION_BEGIN: return "begin";
+        case RTUNE_PROFILE_REGION_END: return "end";
+        case RTUNE_PROFILE_PROVIDER: return "provider";
+        case RTUNE_PROFILE_APPLIER: return "applier";
+        case RTUNE_PROFILE_OBJECTIVE: return "objective";
+        case RTUNE_PROFILE_REGION_BODY: return "body";
+        default: return "unknown";
+    }
+}
+
+static inline void rtune_profile_hist_print(FILE *out, const char *name, const rtune_profile_hist_t *hist) {
+    if (hist->count == 0) return;
+    fprintf(out, "%-10s count=%llu mean=%.1fns min=%lluns p50<=%lluns p99<=%lluns max=%lluns\n", name,
+            (unsigned long long) hist->count, (double) hist->sum_ns / (double) hist->count,
+            (unsigned long long) hist->min_ns, (unsigned long long) rtune_profile_quantile(hist, 0.5),
+            (unsigned long long) rtune_profile_quantile(hist, 0.99), (unsigned long long) hist->max_ns);
+    for (int i = 0; i < RTUNE_PROFILE_NUM_BUCKETS; i++) {
+        if (hist->buckets[i]) fprintf(out, "    [%llu, %llu)ns: %llu\n", i ? 1ull << i : 0ull, 2ull << i, (unsigned long long) hist->buckets[i]);
+    }
+}
+
+static inline void rtune_profile_print(FILE *out, const rtune_profile_t *profile) {
+    for (int p = 0; p < RTUNE_PROFILE_NUM_PROBES; p++) {
+        rtune_profile_hist_print(out, rtune_profile_probe_name((rtune_profile_probe_t) p), &profile->hist[p]);
+    }
+    fprintf(out, "overhead: %.4f of region time\n", rtune_profile_overhead(profile));
+}
+
+#ifdef RTUNE_PROFILE
+#define RTUNE_PROFILE_START(timer, profile, start) \
+    uint64_t start = (profile) ? rtune_profile_now_ns(timer) : 0
+//start is 0 if profiling was enabled after RTUNE_PROFILE_START, the probe is then not recorded
+#define RTUNE_PROFILE_STOP(timer, profile, probe, start) \
+    do { if ((profile) && (start)) rtune_profile_record(&(profile)->hist[probe], rtune_profile_now_ns(timer) - (start)); } while (0)
+#else
+#define RTUNE_PROFILE_START(timer, profile, start)
+#define RTUNE_PROFILE_STOP(timer, profile, probe, start)
+#endif
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef RTUNE_PROVIDER_H
+#define RTUNE_PROVIDER_H
+
+/**
+ * @brief built-in providers of ext/ext_diff vars (rtune_provider_kind_t), defined inline so that reading them in
+ * rtune_regin_begin/rtune_region_end is not an indirect call.
+ *
+ * clock_gettime and pread are POSIX: with -std=c11 compile with -D_DEFAULT_SOURCE (or -D_GNU_SOURCE), as tests/Makefile does.
+ */
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "rtune_api.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define RTUNE_HAVE_TSC 1
+#endif
+
+/************************************* TSC timer ****************************************/
+
+static inline uint64_t rtune_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static inline uint64_t rtune_tsc_ticks(const rtune_tsc_timer_t *timer) {
+#ifdef RTUNE_HAVE_TSC
+    if (timer->use_rdtscp) {
+        unsigned int aux;
+        return __rdtscp(&aux);
+    }
+    return __rdtsc();
+#else
+    (void) timer;
+    return rtune_monotonic_ns(); //no TSC, a tick is a nanosecond
+#endif
+}
+
+/**
+ * calibrate the timer by counting ticks over calibration_ns of CLOCK_MONOTONIC, e.g. 10ms. Without a TSC, the ticks
+ * are CLOCK_MONOTONIC nanoseconds.
+ */
+static inline void rtune_tsc_timer_init(rtune_tsc_timer_t *timer, uint64_t calibration_ns) {
+    timer->use_rdtscp = 1;
+#ifdef RTUNE_HAVE_TSC
+    uint64_t ns0 = rtune_monotonic_ns();
+    uint64_t t0 = rtune_tsc_ticks(timer);
+    uint64_t ns1;
+    do {
+        ns1 = rtune_monotonic_ns();
+    } while (ns1 - ns0 < calibration_ns);
+    uint64_t t1 = rtune_tsc_ticks(timer);
+    timer->seconds_per_tick = (double) (ns1 - ns0) * 1e-9 / (double) (t1 - t0);
+#else
+    (void) calibration_ns;
+    timer->seconds_per_tick = 1e-9;
+#endif
+}
+
+static inline double rtune_tsc_read(const rtune_tsc_timer_t *timer) {
+    return (double) rtune_tsc_ticks(timer) * timer->seconds_per_tick;
+}
+
+/*********************************** energy reader **************************************/
+
+//read an unsigned decimal counter from a sysfs file, return -1 on error or if the file is not a number followed by a newline
+static inline int rtune_sysfs_pread_u64(int fd, uint64_t *value) {
+    char buf[32];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+    if (buf[0] < '0' || buf[0] > '9') return -1; //strtoull accepts leading spaces and signs
+    char *end;
+    unsigned long long v = strtoull(buf, &end, 10);
+    if (*end != '\0' && *end != '\n') return -1;
+    *value = (uint64_t) v;
+    return 0;
+}
+
+static inline void rtune_energy_reader_fini(rtune_energy_reader_t *reader) {
+    for (int i = 0; i < reader->num_zones; i++) close(reader->fd[i]);
+    reader->num_zones = 0;
+}
+
+/**
+ * open the energy_uj files of the top level zones <root>/intel-rapl:N (the packages) under the sysfs root, or
+ * RTUNE_POWERCAP_ROOT if root is NULL. Return the number of zones, 0 if there is none or they are not readable.
+ */
+static inline int rtune_energy_reader_init(rtune_energy_reader_t *reader, const char *root) {
+    char path[4096];
+    if (!root) root = RTUNE_POWERCAP_ROOT;
+    memset(reader, 0, sizeof(*reader));
+    DIR *dir = opendir(root);
+    if (!dir) return 0;
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL && reader->num_zones < RTUNE_ENERGY_MAX_ZONES) {
+        //intel-rapl:N only, the sub-zones intel-rapl:N:M (core, uncore, dram) are included in the package
+        if (strncmp(e->d_name, "intel-rapl:", 11) != 0 || strchr(e->d_name + 11, ':')) continue;
+        int z = reader->num_zones;
+        snprintf(path, sizeof(path), "%s/%s/max_energy_range_uj", root, e->d_name);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) continue;
+        int err = rtune_sysfs_pread_u64(fd, &reader->max_energy_range_uj[z]);
+        close(fd);
+        if (err) continue;
+        snprintf(path, sizeof(path), "%s/%s/energy_uj", root, e->d_name);
+        fd = open(path, O_RDONLY);
+        if (fd < 0) continue;
+        if (rtune_sysfs_pread_u64(fd, &reader->last_uj[z]) != 0) {
+            close(fd);
+            continue;
+        }
+        reader->fd[z] = fd;
+        reader->num_zones++;
+    }
+    closedir(dir);
+    return reader->num_zones;
+}
+
+/**
+ * total energy in joules since the reader is initialized. The counters must be read at least once per half wraparound period.
+ * A reader can be shared by the threads: the reading that moves last_uj of a zone forward with a CAS adds the difference to
+ * the total, and a reading older than last_uj (by less than half the range, otherwise it is a wraparound) is dropped.
+ */
+static inline double rtune_energy_read(rtune_energy_reader_t *reader) {
+    for (int i = 0; i < reader->num_zones; i++) {
+        uint64_t uj;
+        if (rtune_sysfs_pread_u64(reader->fd[i], &uj) != 0) continue;
+        uint64_t last = __atomic_load_n(&reader->last_uj[i], __ATOMIC_ACQUIRE);
+        for (;;) {
+            uint64_t delta = uj >= last ? uj - last : reader->max_energy_range_uj[i] - last + uj;
+            if (delta == 0 || delta > reader->max_energy_range_uj[i] / 2) break; //same or older reading
+            if (__atomic_compare_exchange_n(&reader->last_uj[i], &last, uj, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                __atomic_fetch_add(&reader->total_uj, delta, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+    }
+    return (double) __atomic_load_n(&reader->total_uj, __ATOMIC_RELAXED) * 1e-6;
+}
+
+/********************************** provider dispatch ***********************************/
+
+/**
+ * read the current value of an ext/ext_diff stvar into value. The built-in providers are read inline. A user provider is
+ * either a pointer to the variable (provider == provider_arg), or a function returning the value of the var type, e.g.
+ * "short func(void *arg)" for a short var, as described for rtune_var_t.
+ */
+static inline void rtune_provider_read(const stvar_t *stvar, utype_t *value) {
+    switch (stvar->provider_kind) {
+        case RTUNE_PROVIDER_TSC:
+            value->_double_value = rtune_tsc_read((const rtune_tsc_timer_t *) stvar->provider_arg);
+            return;
+        case RTUNE_PROVIDER_ENERGY:
+            value->_double_value = rtune_energy_read((rtune_energy_reader_t *) stvar->provider_arg);
+            return;
+        default:
+            break;
+    }
+    void *arg = stvar->provider_arg;
+    if ((uintptr_t) stvar->provider == (uintptr_t) arg) {
+        switch (stvar->type) {
+            case RTUNE_short:  value->_short_value = *(short *) arg; break;
+            case RTUNE_int:    value->_int_value = *(int *) arg; break;
+            case RTUNE_long:   value->_long_value = *(long *) arg; break;
+            case RTUNE_float:  value->_float_value = *(float *) arg; break;
+            case RTUNE_double: value->_double_value = *(double *) arg; break;
+            default: value->_typed_value = arg; break;
+        }
+        return;
+    }
+    //the provider is stored as void *(*)(void *), and cast back through void (*)(void) to the function type of the var
+    void (*provider)(void) = (void (*)(void)) stvar->provider;
+    switch (stvar->type) {
+        case RTUNE_short:  value->_short_value = ((short (*)(void *)) provider)(arg); break;
+        case RTUNE_int:    value->_int_value = ((int (*)(void *)) provider)(arg); break;
+        case RTUNE_long:   value->_long_value = ((long (*)(void *)) provider)(arg); break;
+        case RTUNE_float:  value->_float_value = ((float (*)(void *)) provider)(arg); break;
+        case RTUNE_double: value->_double_value = ((double (*)(void *)) provider)(arg); break;
+        default: value->_typed_value = stvar->provider(arg); break;
+    }
+}
+
+#endif
@@ -0,0 +1,304 @@
+#ifndef RTUNE_REGION_H
+#define RTUNE_REGION_H
+
+/**
+ * @brief kernels of the storage of regions: the bump-pointer arena of a region, the doubling of the pointer arrays of
+ * vars/funcs/objectives, and the hash index of the regions keyed on codeptr_ra. Also the conversion of a stored value to
+ * double, used by the funcs and the context buckets.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "rtune_api.h"
+
+static inline double rtune_utype_to_double(rtune_data_type_t type, utype_t v) {
+    switch (type) {
+        case RTUNE_short: return v._short_value;
+        case RTUNE_int: return v._int_value;
+        case RTUNE_long: return (double) v._long_value;
+        case RTUNE_float: return v._float_value;
+        case RTUNE_double: return v._double_value;
+        default: return 0.0;
+    }
+}
+
+#define RTUNE_ARENA_HEADER_SIZE ((sizeof(rtune_arena_block_t) + RTUNE_ARENA_ALIGN - 1) & ~(size_t) (RTUNE_ARENA_ALIGN - 1))
+
+static inline char *rtune_arena_block_data(rtune_arena_block_t *b) {
+    return (char *) b + RTUNE_ARENA_HEADER_SIZE;
+}
+
+//zeroed memory of size bytes aligned at RTUNE_ARENA_ALIGN, NULL if out of memory. A request larger than a block gets its own block
+static inline void *rtune_arena_alloc(rtune_arena_t *a, size_t size) {
+    size = (size + RTUNE_ARENA_ALIGN - 1) & ~(size_t) (RTUNE_ARENA_ALIGN - 1);
+    rtune_arena_block_t *b = a->head;
+    if (!b || b->size - b->used < size) {
+        size_t data_size = size > RTUNE_ARENA_BLOCK_SIZE ? size : RTUNE_ARENA_BLOCK_SIZE;
+        b = (rtune_arena_block_t *) malloc(RTUNE_ARENA_HEADER_SIZE + data_size);
+        if (!b) return NULL;
+        b->size = data_size;
+        b->used = 0;
+        //a large block does not become the head, so the rest of the current head is still used
+        if (a->head && size > RTUNE_ARENA_BLOCK_SIZE) {
+            b->next = a->head->next;
+            a->head->next = b;
+        } else {
+            b->next = a->head;
+            a->head = b;
+        }
+        a->total_size += data_size;
+    }
+    void *p = rtune_arena_block_data(b) + b->used;
+    b->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+static inline void rtune_arena_free(rtune_arena_t *a) {
+    rtune_arena_block_t *b = a->head;
+    while (b) {
+        rtune_arena_block_t *next = b->next;
+        free(b);
+        b = next;
+    }
+    a->head = NULL;
+    a->total_size = 0;
+}
+
+/**
+ * make room for at least needed elements of elem_size in *array, whose capacity is *capacity, by doubling the capacity
+ * from init_capacity. The old array is copied and left in the arena. Return 0, or -1 if out of memory.
+ */
+static inline int rtune_arena_reserve(rtune_arena_t *a, void **array, int *capacity, int needed, size_t elem_size, int init_capacity) {
+    if (needed <= *capacity) return 0;
+    int cap = *capacity > 0 ? *capacity : init_capacity;
+    while (cap < needed) cap *= 2;
+    void *p = rtune_arena_alloc(a, elem_size * (size_t) cap);
+    if (!p) return -1;
+    if (*array) memcpy(p, *array, elem_size * (size_t) *capacity);
+    *array = p;
+    *capacity = cap;
+    return 0;
+}
+
+/**
+ * create a region in its own arena: the region is the first allocation of the arena, and the arena is moved into it.
+ * Return NULL if out of memory.
+ */
+static inline rtune_region_t *rtune_region_alloc(void) {
+    rtune_arena_t a = {NULL, 0};
+    rtune_region_t *region = (rtune_region_t *) rtune_arena_alloc(&a, sizeof(rtune_region_t));
+    if (!region) return NULL;
+    region->arena = a;
+    return region;
+}
+
+//free the region and everything allocated from its arena
+static inline void rtune_region_free(rtune_region_t *region) {
+    rtune_arena_t a = region->arena;
+    rtune_arena_free(&a);
+}
+
+/*********************************** state rings ******************************************/
+
+static inline size_t rtune_data_type_size(rtune_data_type_t type) {
+    switch (type) {
+        case RTUNE_short: return sizeof(short);
+        case RTUNE_int: return sizeof(int);
+        case RTUNE_long: return sizeof(long);
+        case RTUNE_float: return sizeof(float);
+        case RTUNE_double: return sizeof(double);
+        default: return 0;
+    }
+}
+
+//add v to *acc, both of the given type
+static inline void rtune_utype_add(rtune_data_type_t type, utype_t *acc, utype_t v) {
+    switch (type) {
+        case RTUNE_short: acc->_short_value += v._short_value; break;
+        case RTUNE_int: acc->_int_value += v._int_value; break;
+        case RTUNE_long: acc->_long_value += v._long_value; break;
+        case RTUNE_float: acc->_float_value += v._float_value; break;
+        case RTUNE_double: acc->_double_value += v._double_value; break;
+        default: break;
+    }
+}
+
+/**
+ * append n contiguous states of elem_size bytes to the ring, in at most two copies. Only the last capacity states survive.
+ * The typed kernels of rtune_state_ring.hpp do the same per type; the merge of the per-thread buffers only copies.
+ */
+static inline void rtune_state_ring_push_bytes(rtune_state_ring_t *ring, const void *src, unsigned int n, size_t elem_size) {
+    const char *s = (const char *) src;
+    if (n > ring->capacity) {
+        ring->head += n - ring->capacity;
+        s += (size_t) (n - ring->capacity) * elem_size;
+        n = ring->capacity;
+    }
+    unsigned int slot = (unsigned int) ring->head & ring->mask;
+    unsigned int first = ring->capacity - slot < n ? ring->capacity - slot : n;
+    memcpy((char *) ring->values + (size_t) slot * elem_size, s, (size_t) first * elem_size);
+    memcpy(ring->values, s + (size_t) first * elem_size, (size_t) (n - first) * elem_size);
+    ring->head += n;
+}
+
+/******************************* per-thread states ****************************************/
+
+//zeroed memory of size bytes that starts on a cache line and is padded to whole cache lines, NULL if out of memory
+static inline void *rtune_arena_alloc_lines(rtune_arena_t *a, size_t size) {
+    size = (size + RTUNE_CACHE_LINE_SIZE - 1) & ~(size_t) (RTUNE_CACHE_LINE_SIZE - 1);
+    char *p = (char *) rtune_arena_alloc(a, size + RTUNE_CACHE_LINE_SIZE - 1);
+    if (!p) return NULL;
+    return (void *) (((uintptr_t) p + RTUNE_CACHE_LINE_SIZE - 1) & ~(uintptr_t) (RTUNE_CACHE_LINE_SIZE - 1));
+}
+
+static inline size_t rtune_region_tls_round(size_t size) {
+    return (size + RTUNE_ARENA_ALIGN - 1) & ~(size_t) (RTUNE_ARENA_ALIGN - 1);
+}
+
+/**
+ * allocate the per-thread states of a concurrent region for max_num_threads threads, at most MAX_NUM_THREADS, each
+ * buffering up to num_states samples of each var and func between merges. The vars, funcs and sample buffers of a thread
+ * are one block that starts on a cache line and is padded to whole cache lines, so no two threads write to the same
+ * cache line. Must be called after the vars and funcs are added. Return 0, or -1 if out of memory.
+ */
+static inline int rtune_region_tls_alloc(rtune_region_t *region, int max_num_threads, int num_states) {
+    if (max_num_threads < 1) max_num_threads = 1;
+    if (max_num_threads > MAX_NUM_THREADS) max_num_threads = MAX_NUM_THREADS;
+    if (num_states < 1) num_states = 1;
+    rtune_region_tls_t *tls = (rtune_region_tls_t *) rtune_arena_alloc_lines(&region->arena, sizeof(rtune_region_tls_t) * (size_t) max_num_threads);
+    if (!tls) return -1;
+    size_t size = rtune_region_tls_round(sizeof(rtune_stvar_tls_t) * (size_t) (region->num_vars + region->num_funcs));
+    for (int i = 0; i < region->num_vars; i++) size += rtune_region_tls_round(rtune_data_type_size(region->vars[i]->stvar.type) * (size_t) num_states);
+    for (int j = 0; j < region->num_funcs; j++) size += rtune_region_tls_round(rtune_data_type_size(region->funcs[j]->stvar.type) * (size_t) num_states);
+    for (int t = 0; t < max_num_threads; t++) {
+        char *p = (char *) rtune_arena_alloc_lines(&region->arena, size);
+        if (!p) return -1;
+        tls[t].vars = (rtune_stvar_tls_t *) p;
+        tls[t].funcs = tls[t].vars + region->num_vars;
+        tls[t].states_capacity = num_states;
+        p += rtune_region_tls_round(sizeof(rtune_stvar_tls_t) * (size_t) (region->num_vars + region->num_funcs));
+        for (int i = 0; i < region->num_vars + region->num_funcs; i++) {
+            const stvar_t *stvar = i < region->num_vars ? &region->vars[i]->stvar : &region->funcs[i - region->num_vars]->stvar;
+            tls[t].vars[i].states = p;
+            p += rtune_region_tls_round(rtune_data_type_size(stvar->type) * (size_t) num_states);
+        }
+    }
+    region->tls = tls;
+    region->max_num_threads = max_num_threads;
+    return 0;
+}
+
+//per-thread state of a thread, NULL if the thread number is beyond the threads the region was set up for
+static inline rtune_region_tls_t *rtune_region_tls_of(const rtune_region_t *region, int thread) {
+    return (unsigned) thread < (unsigned) region->max_num_threads ? &region->tls[thread] : NULL;
+}
+
+/**
+ * record a sample of stvar (a var or func of the region, whose per-thread buffer of the thread is st) in the buffer of the
+ * thread. Only the thread writes to its buffer, so there is no lock or atomic. A buffer that is full keeps the most recent
+ * samples, as the ring of the stvar would.
+ */
+static inline void rtune_region_tls_record(const rtune_region_tls_t *tls, rtune_stvar_tls_t *st, const stvar_t *stvar, utype_t v) {
+    size_t size = rtune_data_type_size(stvar->type);
+    memcpy((char *) st->states + (size_t) (st->num_states % tls->states_capacity) * size, &v, size);
+    st->num_states++;
+}
+
+//move the samples and the accumulator of the per-thread buffer st into stvar, oldest first
+static inline void rtune_region_tls_merge_stvar(const rtune_region_tls_t *tls, rtune_stvar_tls_t *st, stvar_t *stvar) {
+    rtune_utype_add(stvar->type, &stvar->accu4End_or_accu4Diff, st->accu4End_or_accu4Diff);
+    memset(&st->accu4End_or_accu4Diff, 0, sizeof(utype_t));
+    if (st->num_states == 0) return;
+    size_t size = rtune_data_type_size(stvar->type);
+    unsigned int cap = (unsigned int) tls->states_capacity, n = (unsigned int) st->num_states;
+    if (n > cap) { //the buffer wrapped, the oldest sample kept is at num_states % capacity
+        unsigned int oldest = n % cap;
+        rtune_state_ring_push_bytes(&stvar->states, (char *) st->states + (size_t) oldest * size, cap - oldest, size);
+        rtune_state_ring_push_bytes(&stvar->states, st->states, oldest, size);
+    } else {
+        rtune_state_ring_push_bytes(&stvar->states, st->states, n, size);
+    }
+    stvar->num_states = stvar->states.head < stvar->states.capacity ? (int) stvar->states.head : (int) stvar->states.capacity;
+    st->num_states = 0;
+}
+
+/**
+ * merge the per-thread buffers of all the threads into the states and the accumulators of the vars and funcs, thread by
+ * thread. The per-thread accumulators are added to accu4End_or_accu4Diff of the stvar, the diff bases are per thread and are
+ * kept. Concurrent merges are serialized by merge_lock, and no thread may record into the region while it merges, e.g.
+ * the thread that completes a batch merges after a barrier, or the user merges after the parallel region.
+ */
+static inline void rtune_region_tls_merge(rtune_region_t *region) {
+    while (__atomic_exchange_n(&region->merge_lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&region->merge_lock, __ATOMIC_RELAXED)) {}
+    }
+    for (int t = 0; t < region->max_num_threads; t++) {
+        rtune_region_tls_t *tls = &region->tls[t];
+        for (int i = 0; i < region->num_vars; i++) rtune_region_tls_merge_stvar(tls, &tls->vars[i], &region->vars[i]->stvar);
+        for (int j = 0; j < region->num_funcs; j++) rtune_region_tls_merge_stvar(tls, &tls->funcs[j], &region->funcs[j]->stvar);
+        tls->batch_count = 0;
+    }
+    __atomic_store_n(&region->merge_lock, 0, __ATOMIC_RELEASE);
+}
+
+/************************************** region index ****************************************/
+
+static inline size_t rtune_region_index_hash(const void *key) {
+    uint64_t h = (uint64_t) (uintptr_t) key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return (size_t) h;
+}
+
+//the region of codeptr_ra, NULL if there is none. Does not allocate
+static inline rtune_region_t *rtune_region_index_lookup(const rtune_region_index_t *idx, const void *codeptr_ra) {
+    if (idx->capacity == 0) return NULL;
+    size_t mask = (size_t) idx->capacity - 1;
+    for (size_t i = rtune_region_index_hash(codeptr_ra) & mask;; i = (i + 1) & mask) {
+        if (idx->keys[i] == codeptr_ra) return idx->regions[i];
+        if (!idx->keys[i]) return NULL; //the table is at most half full, thus there is an empty slot
+    }
+}
+
+static inline void rtune_region_index_put(const void **keys, rtune_region_t **regions, int capacity, const void *key, rtune_region_t *region) {
+    size_t mask = (size_t) capacity - 1;
+    size_t i = rtune_region_index_hash(key) & mask;
+    while (keys[i] && keys[i] != key) i = (i + 1) & mask;
+    keys[i] = key;
+    regions[i] = region;
+}
+
+//add or replace the region of codeptr_ra (not NULL), rehashing into a table of twice the capacity when more than half full.
+//Return 0, or -1 if out of memory
+static inline int rtune_region_index_insert(rtune_region_index_t *idx, const void *codeptr_ra, rtune_region_t *region) {
+    if (2 * (idx->num_regions + 1) > idx->capacity) {
+        int capacity = idx->capacity > 0 ? 2 * idx->capacity : RTUNE_INIT_NUM_REGIONS;
+        const void **keys = (const void **) calloc(capacity, sizeof(void *));
+        rtune_region_t **regions = (rtune_region_t **) calloc(capacity, sizeof(rtune_region_t *));
+        if (!keys || !regions) {
+            free(keys);
+            free(regions);
+            return -1;
+        }
+        for (int i = 0; i < idx->capacity; i++) {
+            if (idx->keys[i]) rtune_region_index_put(keys, regions, capacity, idx->keys[i], idx->regions[i]);
+        }
+        free(idx->keys);
+        free(idx->regions);
+        idx->keys = keys;
+        idx->regions = regions;
+        idx->capacity = capacity;
+    }
+    if (!rtune_region_index_lookup(idx, codeptr_ra)) idx->num_regions++;
+    rtune_region_index_put(idx->keys, idx->regions, idx->capacity, codeptr_ra, region);
+    return 0;
+}
+
+static inline void rtune_region_index_free(rtune_region_index_t *idx) {
+    free(idx->keys);
+    free(idx->regions);
+    memset(idx, 0, sizeof(*idx));
+}
+
+#endif
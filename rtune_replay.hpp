@@ -0,0 +1,364 @@
+#ifndef RTUNE_REPLAY_HPP
+#define RTUNE_REPLAY_HPP
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "rtune_api.h"
+#include "rtune_search.hpp"
+
+/**
+ * @brief offline replay of response surfaces through the search kernels of the objectives, with no OpenMP application
+ * and no hardware counter.
+ *
+ * A surface gives the objective func value of each configuration, i.e. of each combination of the value indices of the
+ * vars of an objective (config[].index). One sample of a surface stands for one iteration of the region. A configuration
+ * is evaluated with fidelity_window samples whose mean is reported to the search, the same as the objective does with
+ * the states of its func. Values are minimized.
+ *
+ * The gradient, NELDER_MEAD and SUCCESSIVE_HALVING/UCB strategies drive the kernels of rtune_search.hpp. The exhaustive and
+ * random strategies are reference baselines written in the harness.
+ */
+namespace rtune {
+namespace replay {
+
+class surface {
+public:
+    explicit surface(std::vector<int> num_values, double noise = 0.0) : num_values_(num_values), noise_(noise) {}
+    virtual ~surface() = default;
+
+    int num_vars() const { return (int) num_values_.size(); }
+    const std::vector<int> &num_values() const { return num_values_; }
+    long num_configs() const {
+        long n = 1;
+        for (int v : num_values_) n *= v;
+        return n;
+    }
+
+    //noise-free value of a configuration
+    virtual double truth(const int *index) const = 0;
+
+    //one measurement of a configuration, with multiplicative gaussian noise of relative stddev noise
+    virtual double sample(const int *index, std::mt19937_64 &rng) const {
+        std::normal_distribution<double> n(0.0, noise_);
+        return truth(index) * (1.0 + n(rng));
+    }
+
+    //the true optimum, by visiting every configuration
+    double optimum(std::vector<int> *index = NULL) const {
+        std::vector<int> x(num_vars(), 0);
+        double best = truth(x.data());
+        if (index) *index = x;
+        for (long c = 1; c < num_configs(); c++) {
+            long r = c;
+            for (int d = 0; d < num_vars(); d++) {
+                x[d] = (int) (r % num_values_[d]);
+                r /= num_values_[d];
+            }
+            double v = truth(x.data());
+            if (v < best) {
+                best = v;
+                if (index) *index = x;
+            }
+        }
+        return best;
+    }
+
+protected:
+    std::vector<int> num_values_;
+    double noise_;
+};
+
+//bowl around center: 1 + sum(((x-c)/n)^2)
+class unimodal_surface : public surface {
+public:
+    unimodal_surface(std::vector<int> num_values, std::vector<int> center, double noise)
+        : surface(num_values, noise), center_(center) {}
+    double truth(const int *index) const override {
+        double v = 1.0;
+        for (int d = 0; d < num_vars(); d++) {
+            double x = (double) (index[d] - center_[d]) / num_values_[d];
+            v += x * x;
+        }
+        return v;
+    }
+protected:
+    std::vector<int> center_;
+};
+
+//unimodal bowl with cosine ripples of the given period (in indices) and relative amplitude, which create local minima
+class multimodal_surface : public unimodal_surface {
+public:
+    multimodal_surface(std::vector<int> num_values, std::vector<int> center, double noise, int period, double amplitude)
+        : unimodal_surface(num_values, center, noise), period_(period), amplitude_(amplitude) {}
+    double truth(const int *index) const override {
+        double ripple = 0.0;
+        for (int d = 0; d < num_vars(); d++) ripple += 1.0 - std::cos(2.0 * M_PI * (index[d] - center_[d]) / period_);
+        return unimodal_surface::truth(index) + amplitude_ * ripple;
+    }
+private:
+    int period_;
+    double amplitude_;
+};
+
+//unimodal bowl that is flat within radius (in indices) of the center, thus many configurations are optimal
+class plateau_surface : public unimodal_surface {
+public:
+    plateau_surface(std::vector<int> num_values, std::vector<int> center, double noise, int radius)
+        : unimodal_surface(num_values, center, noise), radius_(radius) {}
+    double truth(const int *index) const override {
+        std::vector<int> shifted(num_vars());
+        for (int d = 0; d < num_vars(); d++) {
+            int off = index[d] - center_[d];
+            shifted[d] = center_[d] + (off > radius_ ? off - radius_ : (off < -radius_ ? off + radius_ : 0));
+        }
+        return unimodal_surface::truth(shifted.data());
+    }
+private:
+    int radius_;
+};
+
+/**
+ * recorded samples of a single var, e.g. the func states collected for each value of a list/range var. Sampling picks
+ * one of the recorded samples of the value at random, and the truth is their mean.
+ */
+class recorded_surface : public surface {
+public:
+    explicit recorded_surface(std::vector<std::vector<double>> samples)
+        : surface(std::vector<int>(1, (int) samples.size())), samples_(samples) {}
+
+    //read "index,value" lines, e.g. extracted from the CSV of rtune_trace2csv. Returns false if no sample is read
+    bool load_csv(FILE *in) {
+        int index;
+        double value;
+        char line[256];
+        while (fgets(line, sizeof(line), in)) {
+            if (sscanf(line, "%d,%lf", &index, &value) != 2 || index < 0) continue;
+            if (index >= (int) samples_.size()) samples_.resize(index + 1);
+            samples_[index].push_back(value);
+        }
+        num_values_[0] = (int) samples_.size();
+        return !samples_.empty();
+    }
+
+    double truth(const int *index) const override {
+        const std::vector<double> &s = samples_[index[0]];
+        if (s.empty()) return HUGE_VAL;
+        double sum = 0.0;
+        for (double v : s) sum += v;
+        return sum / s.size();
+    }
+    double sample(const int *index, std::mt19937_64 &rng) const override {
+        const std::vector<double> &s = samples_[index[0]];
+        if (s.empty()) return HUGE_VAL;
+        return s[std::uniform_int_distribution<size_t>(0, s.size() - 1)(rng)];
+    }
+private:
+    std::vector<std::vector<double>> samples_;
+};
+
+struct settings {
+    rtune_objective_search_strategy_t search_strategy = RTUNE_OBJECTIVE_SEARCH_DEFAULT;
+    float deviation_tolerance = DEFAULT_DEVIATION_TOLERANCE;
+    int fidelity_window = DEFAULT_FIDELITY_WINDOW; //samples per evaluation of a configuration
+    int lookup_window = DEFAULT_LOOKUP_WINDOW;     //on-the-fly search stops after this many evaluations that are not better than the best
+    int max_iterations = 100000;
+    int search_budget = 0; //max evaluations of NELDER_MEAD and SUCCESSIVE_HALVING/UCB, 0 for the default of the objective
+    double exploration = RTUNE_SEARCH_DEFAULT_EXPLORATION;
+};
+
+struct result {
+    int iterations = 0;     //samples taken, i.e. region iterations spent exploring
+    int evaluations = 0;    //configurations evaluated
+    std::vector<int> config; //the configuration the search converged to
+    double regret = 0.0;    //(truth(config) - optimum) / |optimum|, or truth(config) - optimum if the optimum is 0
+    bool supported = true;  //false if the harness does not model the search strategy, the other fields are then not set
+    double ns_per_evaluation = 0.0; //time of the search per evaluation, less the time of a loop of as many samples
+};
+
+class harness {
+public:
+    harness(const surface &s, const settings &st, unsigned long seed) : s_(s), st_(st), rng_(seed) {}
+
+    result run() {
+        result r;
+        r.config.assign(s_.num_vars(), 0);
+        clock::time_point t = clock::now();
+        switch (st_.search_strategy) {
+            case RTUNE_OBJECTIVE_SEARCH_EXHAUSTIVE_AFTER_COMPLETE: exhaustive(r, false); break;
+            case RTUNE_OBJECTIVE_SEARCH_EXHAUSTIVE_ON_THE_FLY: exhaustive(r, true); break;
+            case RTUNE_OBJECTIVE_SEARCH_UNIMODAL_ON_THE_FLY:
+                r.supported = false;
+                return r;
+            case RTUNE_OBJECTIVE_SEARCH_RANDOM: random(r); break;
+            case RTUNE_OBJECTIVE_SEARCH_NELDER_MEAD: simplex(r); break;
+            case RTUNE_OBJECTIVE_SEARCH_SUCCESSIVE_HALVING: bandit(r, 0); break;
+            case RTUNE_OBJECTIVE_SEARCH_UCB: bandit(r, 1); break;
+            case RTUNE_OBJECTIVE_SEARCH_BINARY_GRADIENT:
+            case RTUNE_OBJECTIVE_SEARCH_QUATERNARY_GRADIENT:
+            case RTUNE_OBJECTIVE_SEARCH_OCTAL_GRADIENT:
+            case RTUNE_OBJECTIVE_SEARCH_HEX_GRADIENT: gradient(r, search::strategy_arity(st_.search_strategy)); break;
+            default:
+                r.supported = false;
+                return r;
+        }
+        double total_ns = std::chrono::duration<double, std::nano>(clock::now() - t).count();
+        double opt = s_.optimum();
+        r.regret = s_.truth(r.config.data()) - opt;
+        if (opt != 0.0) r.regret /= std::fabs(opt);
+        if (r.evaluations) {
+            double search_ns = total_ns - sampling_ns(r);
+            r.ns_per_evaluation = search_ns > 0.0 ? search_ns / r.evaluations : 0.0;
+        }
+        return r;
+    }
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    double evaluate(const int *index, result &r) {
+        double sum = 0.0;
+        for (int i = 0; i < st_.fidelity_window; i++) sum += s_.sample(index, rng_);
+        r.iterations += st_.fidelity_window;
+        r.evaluations++;
+        return sum / st_.fidelity_window;
+    }
+
+    /**
+     * time of the sampling alone of the search of r: as many evaluations of r.config as the search made, with a copy of the
+     * generator so that later runs get the same samples. The search is timed once as a whole and this is subtracted, so the
+     * clock is not read around each call of the kernels.
+     */
+    double sampling_ns(const result &r) const {
+        std::mt19937_64 rng = rng_;
+        volatile double sink = 0.0;
+        clock::time_point t = clock::now();
+        for (int e = 0; e < r.evaluations; e++) {
+            double sum = 0.0;
+            for (int i = 0; i < st_.fidelity_window; i++) sum += s_.sample(r.config.data(), rng);
+            sink = sink + sum / st_.fidelity_window;
+        }
+        return std::chrono::duration<double, std::nano>(clock::now() - t).count();
+    }
+
+    bool budget_left(const result &r) const { return r.iterations + st_.fidelity_window <= st_.max_iterations; }
+
+    void to_index(long c, int *x) const {
+        for (int d = 0; d < s_.num_vars(); d++) {
+            x[d] = (int) (c % s_.num_values()[d]);
+            c /= s_.num_values()[d];
+        }
+    }
+
+    //reference baseline, rtune_search.hpp has no kernel for it
+    void exhaustive(result &r, bool on_the_fly) {
+        std::vector<int> x(s_.num_vars());
+        double best = HUGE_VAL;
+        int not_better = 0;
+        for (long c = 0; c < s_.num_configs() && budget_left(r); c++) {
+            to_index(c, x.data());
+            double v = evaluate(x.data(), r);
+            if (v < best - st_.deviation_tolerance || best == HUGE_VAL) { //deviation_tolerance is absolute
+                best = v;
+                r.config = x;
+                not_better = 0;
+            } else if (on_the_fly && ++not_better >= st_.lookup_window) {
+                break;
+            }
+        }
+    }
+
+    //reference baseline, rtune_search.hpp has no kernel for it
+    void random(result &r) {
+        std::vector<int> x(s_.num_vars());
+        double best = HUGE_VAL;
+        std::uniform_int_distribution<long> pick(0, s_.num_configs() - 1);
+        for (long n = 0; n < s_.num_configs() && budget_left(r); n++) {
+            to_index(pick(rng_), x.data());
+            double v = evaluate(x.data(), r);
+            if (v < best) {
+                best = v;
+                r.config = x;
+            }
+        }
+    }
+
+    //the vars are searched one after another, the others are fixed at their current best
+    void gradient(result &r, int arity) {
+        std::vector<int> x(s_.num_vars(), 0);
+        for (int d = 0; d < s_.num_vars(); d++) x[d] = s_.num_values()[d] / 2;
+        for (int d = 0; d < s_.num_vars(); d++) {
+            rtune_search_bracket_t b;
+            search::bracket_begin(&b, arity, 0, s_.num_values()[d] - 1);
+            int i = search::bracket_next(&b);
+            while (i >= 0 && budget_left(r)) {
+                x[d] = i;
+                double v = evaluate(x.data(), r);
+                search::bracket_report(&b, v);
+                i = search::bracket_next(&b);
+            }
+            x[d] = b.best_index >= 0 ? b.best_index : x[d];
+        }
+        r.config = x;
+    }
+
+    void simplex(result &r) {
+        int n = s_.num_vars();
+        std::vector<int> vertices((n + 1) * n), trial(n), reflect(n), point(n), start(n);
+        std::vector<double> values(n + 1);
+        rtune_search_simplex_t s;
+        s.n = n;
+        s.num_values = s_.num_values().data();
+        s.vertices = vertices.data();
+        s.values = values.data();
+        s.trial = trial.data();
+        s.reflect = reflect.data();
+        for (int d = 0; d < n; d++) start[d] = s_.num_values()[d] / 2;
+        search::simplex_begin(&s, start.data(), st_.deviation_tolerance, st_.search_budget);
+        int more = search::simplex_next(&s, point.data());
+        while (more && budget_left(r)) {
+            double v = evaluate(point.data(), r);
+            search::simplex_report(&s, v);
+            more = search::simplex_next(&s, point.data());
+        }
+        r.config.assign(vertices.begin(), vertices.begin() + n);
+    }
+
+    void bandit(result &r, int ucb) {
+        int n = s_.num_vars();
+        std::vector<int> arms(RTUNE_SEARCH_MAX_ARMS * n), alive(RTUNE_SEARCH_MAX_ARMS), point(n);
+        std::vector<double> sum(RTUNE_SEARCH_MAX_ARMS);
+        std::vector<long> count(RTUNE_SEARCH_MAX_ARMS);
+        rtune_search_bandit_t s;
+        s.n = n;
+        s.num_values = s_.num_values().data();
+        s.preference_right = nullptr;
+        s.count_value = nullptr;
+        s.max_arms = RTUNE_SEARCH_MAX_ARMS;
+        s.arms = arms.data();
+        s.sum = sum.data();
+        s.count = count.data();
+        s.alive = alive.data();
+        search::bandit_begin(&s, ucb, st_.search_budget, st_.exploration, rng_());
+        int more = search::bandit_next(&s, point.data());
+        while (more && budget_left(r)) {
+            double v = evaluate(point.data(), r);
+            search::bandit_report(&s, v);
+            more = search::bandit_next(&s, point.data());
+        }
+        if (!s.converged) search::bandit_finish(&s);
+        const int *best = search::bandit_arm(&s, s.best);
+        r.config.assign(best, best + n);
+    }
+
+    const surface &s_;
+    settings st_;
+    std::mt19937_64 rng_;
+};
+
+} // namespace replay
+} // namespace rtune
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef RTUNE_SAMPLING_H
+#define RTUNE_SAMPLING_H
+
+/**
+ * @brief kernels of the adaptive sampling modes: streaming mean/variance (Welford), median/MAD outlier rejection, the decision
+ * whether a candidate is separated from the best, and the round-robin racing of candidates.
+ *
+ * Values are compared for minimization; a maximizing objective negates its samples before adding them.
+ */
+#include <math.h>
+#include <string.h>
+#include "rtune_api.h"
+
+#define RTUNE_SAMPLING_MAD_SCALE 1.4826 //MAD to stddev for normally distributed samples
+
+static inline void rtune_sample_stats_reset(rtune_sample_stats_t *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+static inline double rtune_sample_stats_variance(const rtune_sample_stats_t *s) {
+    return s->count > 1 ? s->m2 / (double) (s->count - 1) : 0.0;
+}
+
+//Student t quantile of df degrees of freedom for the normal quantile z (Cornish-Fisher expansion), the intervals of the first
+//few samples of a candidate would otherwise be too narrow
+static inline double rtune_sampling_t_quantile(double z, long df) {
+    double z3 = z * z * z, d = (double) df;
+    return z + (z3 + z) / (4.0 * d) + (5.0 * z3 * z * z + 16.0 * z3 + 3.0 * z) / (96.0 * d * d);
+}
+
+//half width of the confidence interval of the mean
+static inline double rtune_sample_stats_halfwidth(const rtune_sample_stats_t *s, double confidence) {
+    if (s->count < 2) return INFINITY;
+    return rtune_sampling_t_quantile(confidence, s->count - 1) * sqrt(rtune_sample_stats_variance(s) / (double) s->count);
+}
+
+//median of a[n], a is reordered
+static inline double rtune_sampling_median(double *a, int n) {
+    for (int i = 1; i < n; i++) { //insertion sort, n is at most RTUNE_SAMPLING_ROBUST_WINDOW
+        double v = a[i];
+        int j = i - 1;
+        for (; j >= 0 && a[j] > v; j--) a[j + 1] = a[j];
+        a[j + 1] = v;
+    }
+    return n & 1 ? a[n / 2] : 0.5 * (a[n / 2 - 1] + a[n / 2]);
+}
+
+//whether x is an outlier of the recent samples of s. Needs at least half a window of samples, and a MAD of 0 rejects nothing
+static inline int rtune_sample_stats_is_outlier(const rtune_sample_stats_t *s, double x, double outlier_mads) {
+    int n = s->window_count < RTUNE_SAMPLING_ROBUST_WINDOW ? (int) s->window_count : RTUNE_SAMPLING_ROBUST_WINDOW;
+    if (outlier_mads <= 0.0 || n < RTUNE_SAMPLING_ROBUST_WINDOW / 2) return 0;
+    double a[RTUNE_SAMPLING_ROBUST_WINDOW];
+    memcpy(a, s->window, sizeof(double) * n);
+    double median = rtune_sampling_median(a, n);
+    for (int i = 0; i < n; i++) a[i] = fabs(a[i] - median);
+    double mad = rtune_sampling_median(a, n);
+    return mad > 0.0 && fabs(x - median) > outlier_mads * RTUNE_SAMPLING_MAD_SCALE * mad;
+}
+
+/**
+ * add a sample. Return 0 if it is accepted, -1 if it is rejected as an outlier. After RTUNE_SAMPLING_MAX_CONSECUTIVE_REJECTS
+ * rejections in a row, the sample is accepted and restarts the window and the mean and variance, which thus re-centre on a
+ * level that has shifted instead of blending both levels. The samples of the old level are then counted as rejected, so
+ * that rtune_sample_stats_taken, and thus max_samples, still count them.
+ */
+static inline int rtune_sample_stats_add(rtune_sample_stats_t *s, double x, double outlier_mads) {
+    if (rtune_sample_stats_is_outlier(s, x, outlier_mads)) {
+        if (s->consecutive_rejected < RTUNE_SAMPLING_MAX_CONSECUTIVE_REJECTS) {
+            s->num_rejected++;
+            s->consecutive_rejected++;
+            return -1;
+        }
+        s->window_count = 0;
+        s->num_rejected += s->count;
+        s->count = 0;
+        s->mean = 0.0;
+        s->m2 = 0.0;
+    }
+    s->consecutive_rejected = 0;
+    s->window[s->window_count++ % RTUNE_SAMPLING_ROBUST_WINDOW] = x;
+    s->count++;
+    double delta = x - s->mean;
+    s->mean += delta / (double) s->count;
+    s->m2 += delta * (x - s->mean);
+    return 0;
+}
+
+//samples taken of a candidate, accepted or rejected
+static inline long rtune_sample_stats_taken(const rtune_sample_stats_t *s) {
+    return s->count + s->num_rejected;
+}
+
+/**
+ * decide a candidate against the best so far (NULL if there is none yet, then the candidate is BETTER once it has min_samples).
+ * The candidate is WORSE if its lower bound is above the upper bound of the best minus tolerance, i.e. it cannot be better
+ * by more than tolerance, and BETTER if its upper bound is below the lower bound of the best minus tolerance. tolerance is
+ * absolute, in the unit of the values. EXHAUSTED once max_samples samples are taken, the rejected ones included.
+ */
+static inline rtune_sampling_decision_t rtune_sampling_decide(const rtune_sample_stats_t *cand, const rtune_sample_stats_t *best,
+                                                              double confidence, double tolerance, int min_samples, int max_samples) {
+    if (cand->count < min_samples || cand->count < 2) return RTUNE_SAMPLING_CONTINUE;
+    if (!best) return RTUNE_SAMPLING_BETTER;
+    double hc = rtune_sample_stats_halfwidth(cand, confidence);
+    double hb = rtune_sample_stats_halfwidth(best, confidence);
+    if (cand->mean - hc > best->mean + hb - tolerance) return RTUNE_SAMPLING_WORSE;
+    if (cand->mean + hc < best->mean - hb - tolerance) return RTUNE_SAMPLING_BETTER;
+    return rtune_sample_stats_taken(cand) >= max_samples ? RTUNE_SAMPLING_EXHAUSTED : RTUNE_SAMPLING_CONTINUE;
+}
+
+//index of the alive candidate with the min mean, ties go to the right if preference_right. -1 if no candidate has a sample
+static inline int rtune_sampling_race_leader(const rtune_sample_stats_t *stats, int num_candidates, int preference_right) {
+    int leader = -1;
+    for (int c = 0; c < num_candidates; c++) {
+        if (stats[c].eliminated || stats[c].count == 0) continue;
+        if (leader < 0 || stats[c].mean < stats[leader].mean || (preference_right && stats[c].mean == stats[leader].mean)) leader = c;
+    }
+    return leader;
+}
+
+/**
+ * eliminate the candidates that are worse than the leader with confidence, once every alive candidate has min_samples.
+ * Return the number of alive candidates.
+ */
+static inline int rtune_sampling_race_eliminate(rtune_sample_stats_t *stats, int num_candidates, double confidence, double tolerance,
+                                                int min_samples, int preference_right) {
+    int alive = 0, ready = 1;
+    for (int c = 0; c < num_candidates; c++) {
+        if (stats[c].eliminated) continue;
+        alive++;
+        if (stats[c].count < min_samples || stats[c].count < 2) ready = 0;
+    }
+    int leader = rtune_sampling_race_leader(stats, num_candidates, preference_right);
+    if (!ready || leader < 0) return alive;
+    for (int c = 0; c < num_candidates; c++) {
+        if (c == leader || stats[c].eliminated) continue;
+        if (rtune_sampling_decide(&stats[c], &stats[leader], confidence, tolerance, min_samples, 0x7fffffff) == RTUNE_SAMPLING_WORSE) {
+            stats[c].eliminated = 1;
+            alive--;
+        }
+    }
+    return alive;
+}
+
+/**
+ * next candidate to sample in a race: the alive candidate with the fewest samples taken, lowest index first. Return -1 when
+ * the race is over, i.e. one candidate is left or max_samples samples are taken of all the alive candidates; the winner is
+ * then the leader.
+ */
+static inline int rtune_sampling_race_next(const rtune_sample_stats_t *stats, int num_candidates, int max_samples) {
+    int next = -1, alive = 0;
+    for (int c = 0; c < num_candidates; c++) {
+        if (stats[c].eliminated) continue;
+        alive++;
+        long taken = rtune_sample_stats_taken(&stats[c]);
+        if (taken < max_samples && (next < 0 || taken < rtune_sample_stats_taken(&stats[next]))) next = c;
+    }
+    return alive > 1 ? next : -1;
+}
+
+#endif
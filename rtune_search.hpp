@@ -0,0 +1,527 @@
+#ifndef RTUNE_SEARCH_HPP
+#define RTUNE_SEARCH_HPP
+
+#include <cmath>
+#include <cstdint>
+#include "rtune_api.h"
+
+/**
+ * @brief search kernels of the NELDER_MEAD, SUCCESSIVE_HALVING, UCB and BINARY/QUATERNARY/OCTAL/HEX_GRADIENT strategies, used by the runtime behind
+ * rtune_objective_set_search_strategy.
+ *
+ * Each search is a state machine driven by the objective evaluation: *_next() gives the value indices to apply for the
+ * next evaluation (or tells that the search is converged), and *_report() takes the objective value measured with them.
+ * Values are minimized.
+ */
+namespace rtune {
+namespace search {
+
+/************************** BINARY/QUATERNARY/OCTAL/HEX_GRADIENT ****************************/
+
+inline int strategy_arity(rtune_objective_search_strategy_t strategy) {
+    switch (strategy) {
+        case RTUNE_OBJECTIVE_SEARCH_BINARY_GRADIENT: return 2;
+        case RTUNE_OBJECTIVE_SEARCH_QUATERNARY_GRADIENT: return 4;
+        case RTUNE_OBJECTIVE_SEARCH_OCTAL_GRADIENT: return 8;
+        case RTUNE_OBJECTIVE_SEARCH_HEX_GRADIENT: return 16;
+        default: return 0;
+    }
+}
+
+//plan the probes for the current [left, right], reusing the values of the previous round at the same indices
+inline void bracket_plan(rtune_search_bracket_t *b) {
+    int old_num_probes = b->num_probes;
+    int old_index[RTUNE_SEARCH_MAX_ARITY+1];
+    double old_value[RTUNE_SEARCH_MAX_ARITY+1];
+    unsigned int old_done = b->probe_done;
+    for (int i = 0; i < old_num_probes; i++) {
+        old_index[i] = b->probe_index[i];
+        old_value[i] = b->probe_value[i];
+    }
+
+    int span = b->right - b->left;
+    if (span <= b->arity) { //last round, probe every index
+        b->num_probes = span + 1;
+        for (int i = 0; i <= span; i++) b->probe_index[i] = b->left + i;
+    } else if (b->arity == 2) { //the gradient at the middle
+        int mid = b->left + span / 2;
+        b->num_probes = 2;
+        b->probe_index[0] = mid;
+        b->probe_index[1] = mid + 1;
+    } else {
+        b->num_probes = b->arity + 1;
+        for (int i = 0; i <= b->arity; i++) b->probe_index[i] = b->left + (int) (((long) span * i) / b->arity);
+    }
+
+    b->probe_done = 0;
+    for (int i = 0; i < b->num_probes; i++) {
+        for (int j = 0; j < old_num_probes; j++) {
+            if ((old_done & (1u << j)) && old_index[j] == b->probe_index[i]) {
+                b->probe_value[i] = old_value[j];
+                b->probe_done |= 1u << i;
+                break;
+            }
+        }
+    }
+}
+
+//arity is clamped to [2, RTUNE_SEARCH_MAX_ARITY], e.g. strategy_arity gives 0 for a strategy that is not a gradient one
+inline void bracket_begin(rtune_search_bracket_t *b, int arity, int left, int right) {
+    b->arity = arity < 2 ? 2 : arity > RTUNE_SEARCH_MAX_ARITY ? RTUNE_SEARCH_MAX_ARITY : arity;
+    b->left = left;
+    b->right = right;
+    b->num_probes = 0;
+    b->probe_done = 0;
+    b->best_index = -1;
+    b->best_value = 0.0;
+    b->converged = 0;
+    b->num_evaluations = 0;
+    bracket_plan(b);
+}
+
+//the value index to evaluate next, or -1 if the search is converged and best_index is the result
+inline int bracket_next(const rtune_search_bracket_t *b) {
+    if (b->converged) return -1;
+    for (int i = 0; i < b->num_probes; i++) {
+        if (!(b->probe_done & (1u << i))) return b->probe_index[i];
+    }
+    return -1;
+}
+
+//narrow the range once all the probes of the round are known
+inline void bracket_narrow(rtune_search_bracket_t *b) {
+    int span = b->right - b->left;
+    if (span <= b->arity) {
+        b->converged = 1;
+        return;
+    }
+    if (b->arity == 2) {
+        if (b->probe_value[0] <= b->probe_value[1]) b->right = b->probe_index[0];
+        else b->left = b->probe_index[1];
+    } else {
+        int best = 0;
+        for (int i = 1; i < b->num_probes; i++) {
+            if (b->probe_value[i] < b->probe_value[best]) best = i;
+        }
+        if (best > 0) b->left = b->probe_index[best-1];
+        if (best < b->num_probes - 1) b->right = b->probe_index[best+1];
+    }
+    if (b->left == b->right) {
+        b->converged = 1;
+        return;
+    }
+    bracket_plan(b);
+}
+
+inline void bracket_report(rtune_search_bracket_t *b, double value) {
+    for (int i = 0; i < b->num_probes; i++) {
+        if (b->probe_done & (1u << i)) continue;
+        b->probe_value[i] = value;
+        b->probe_done |= 1u << i;
+        b->num_evaluations++;
+        if (b->best_index < 0 || value < b->best_value) {
+            b->best_index = b->probe_index[i];
+            b->best_value = value;
+        }
+        break;
+    }
+    if (b->probe_done == (1u << b->num_probes) - 1) bracket_narrow(b);
+}
+
+/**************************************** NELDER_MEAD ***************************************/
+
+enum simplex_phase {
+    SIMPLEX_INIT,
+    SIMPLEX_REFLECT,
+    SIMPLEX_EXPAND,
+    SIMPLEX_CONTRACT,
+    SIMPLEX_SHRINK,
+};
+
+inline int *simplex_vertex(const rtune_search_simplex_t *s, int i) {
+    return s->vertices + i * s->n;
+}
+
+inline int simplex_clamp(const rtune_search_simplex_t *s, int d, double x) {
+    long v = std::lround(x);
+    if (v < 0) return 0;
+    if (v > s->num_values[d] - 1) return s->num_values[d] - 1;
+    return (int) v;
+}
+
+//point = round(centroid + coef * (centroid - worst)), where centroid is the centroid of all the vertices but the worst
+inline void simplex_move(const rtune_search_simplex_t *s, double coef, int *point) {
+    const int *worst = simplex_vertex(s, s->n);
+    for (int d = 0; d < s->n; d++) {
+        double c = 0.0;
+        for (int i = 0; i < s->n; i++) c += simplex_vertex(s, i)[d];
+        c /= s->n;
+        point[d] = simplex_clamp(s, d, c + coef * (c - worst[d]));
+    }
+}
+
+inline void simplex_copy(const rtune_search_simplex_t *s, int *dst, const int *src) {
+    for (int d = 0; d < s->n; d++) dst[d] = src[d];
+}
+
+inline int simplex_equal(const rtune_search_simplex_t *s, const int *a, const int *b) {
+    for (int d = 0; d < s->n; d++) {
+        if (a[d] != b[d]) return 0;
+    }
+    return 1;
+}
+
+//sort the vertices by value (insertion sort, n is small), check convergence and set up the reflection
+inline void simplex_order(rtune_search_simplex_t *s) {
+    for (int i = 1; i <= s->n; i++) {
+        double v = s->values[i];
+        int j = i - 1;
+        while (j >= 0 && s->values[j] > v) j--;
+        j++;
+        if (j == i) continue;
+        simplex_copy(s, s->trial, simplex_vertex(s, i));
+        for (int k = i; k > j; k--) {
+            simplex_copy(s, simplex_vertex(s, k), simplex_vertex(s, k-1));
+            s->values[k] = s->values[k-1];
+        }
+        simplex_copy(s, simplex_vertex(s, j), s->trial);
+        s->values[j] = v;
+    }
+
+    //the initial simplex alone does not converge: in 1-D its two vertices may be close only because they are on the same side
+    double spread = s->values[s->n] - s->values[0];
+    if ((s->num_steps > 0 && spread <= s->tolerance) || s->num_evaluations >= s->max_evaluations) {
+        s->converged = 1;
+        return;
+    }
+
+    simplex_move(s, 1.0, s->reflect);
+    if (simplex_equal(s, s->reflect, simplex_vertex(s, s->n))) { //degenerated on the lattice
+        simplex_move(s, -0.5, s->trial);
+        s->phase = SIMPLEX_CONTRACT;
+    } else {
+        simplex_copy(s, s->trial, s->reflect);
+        s->phase = SIMPLEX_REFLECT;
+    }
+}
+
+/**
+ * start the search from the vertex start and its neighbors: vertex i (i>0) is start moved by one quarter of the range of var i-1.
+ * max_evaluations is RTUNE_SEARCH_DEFAULT_BUDGET if it is 0.
+ */
+inline void simplex_begin(rtune_search_simplex_t *s, const int *start, double tolerance, int max_evaluations) {
+    for (int i = 0; i <= s->n; i++) {
+        int *v = simplex_vertex(s, i);
+        simplex_copy(s, v, start);
+        if (i == 0) continue;
+        int d = i - 1;
+        int step = s->num_values[d] / 4 > 1 ? s->num_values[d] / 4 : 1;
+        v[d] = start[d] + step < s->num_values[d] ? start[d] + step : start[d] - step;
+        if (v[d] < 0) v[d] = 0;
+    }
+    s->tolerance = tolerance;
+    s->max_evaluations = max_evaluations > 0 ? max_evaluations : RTUNE_SEARCH_DEFAULT_BUDGET;
+    s->converged = 0;
+    s->num_evaluations = 0;
+    s->num_steps = 0;
+    s->phase = SIMPLEX_INIT;
+    s->vertex = 0;
+    simplex_copy(s, s->trial, start);
+}
+
+//fill point with the value indices to evaluate next and return 1, or return 0 if converged and vertex 0 is the result
+inline int simplex_next(const rtune_search_simplex_t *s, int *point) {
+    if (s->converged) return 0;
+    simplex_copy(s, point, s->trial);
+    return 1;
+}
+
+//shrink all the vertices toward the best. Converged if none of them moves on the lattice
+inline void simplex_shrink(rtune_search_simplex_t *s) {
+    const int *best = simplex_vertex(s, 0);
+    int moved = 0;
+    for (int i = 1; i <= s->n; i++) {
+        int *v = simplex_vertex(s, i);
+        for (int d = 0; d < s->n; d++) {
+            int x = simplex_clamp(s, d, best[d] + 0.5 * (v[d] - best[d]));
+            moved |= x != v[d];
+            v[d] = x;
+        }
+    }
+    if (!moved) {
+        s->converged = 1;
+        return;
+    }
+    s->phase = SIMPLEX_SHRINK;
+    s->vertex = 1;
+    simplex_copy(s, s->trial, simplex_vertex(s, 1));
+}
+
+inline void simplex_report(rtune_search_simplex_t *s, double value) {
+    int n = s->n;
+    s->num_evaluations++;
+    if (s->phase != SIMPLEX_INIT) s->num_steps++;
+    switch (s->phase) {
+        case SIMPLEX_INIT:
+        case SIMPLEX_SHRINK:
+            s->values[s->vertex] = value;
+            if (s->vertex < n) {
+                s->vertex++;
+                simplex_copy(s, s->trial, simplex_vertex(s, s->vertex));
+            } else {
+                simplex_order(s);
+            }
+            break;
+        case SIMPLEX_REFLECT:
+            if (value < s->values[0]) {
+                s->reflect_value = value;
+                simplex_move(s, 2.0, s->trial);
+                s->phase = SIMPLEX_EXPAND;
+            } else if (value < s->values[n-1]) {
+                simplex_copy(s, simplex_vertex(s, n), s->reflect);
+                s->values[n] = value;
+                simplex_order(s);
+            } else {
+                simplex_move(s, -0.5, s->trial);
+                s->phase = SIMPLEX_CONTRACT;
+            }
+            break;
+        case SIMPLEX_EXPAND:
+            if (value < s->reflect_value) {
+                simplex_copy(s, simplex_vertex(s, n), s->trial);
+                s->values[n] = value;
+            } else {
+                simplex_copy(s, simplex_vertex(s, n), s->reflect);
+                s->values[n] = s->reflect_value;
+            }
+            simplex_order(s);
+            break;
+        case SIMPLEX_CONTRACT:
+            if (value < s->values[n]) {
+                simplex_copy(s, simplex_vertex(s, n), s->trial);
+                s->values[n] = value;
+                simplex_order(s);
+            } else {
+                simplex_shrink(s);
+            }
+            break;
+    }
+}
+
+/********************************** SUCCESSIVE_HALVING/UCB **********************************/
+
+inline int *bandit_arm(const rtune_search_bandit_t *s, int a) {
+    return s->arms + a * s->n;
+}
+
+inline double bandit_mean(const rtune_search_bandit_t *s, int a) {
+    return s->count[a] ? s->sum[a] / (double) s->count[a] : HUGE_VAL;
+}
+
+inline uint64_t bandit_rand(rtune_search_bandit_t *s) { //xorshift64*
+    s->rng ^= s->rng >> 12;
+    s->rng ^= s->rng << 25;
+    s->rng ^= s->rng >> 27;
+    return s->rng * 0x2545f4914f6cdd1dull;
+}
+
+//whether arm a is preferred to arm b when their means are equal
+inline int bandit_prefer(const rtune_search_bandit_t *s, int a, int b) {
+    const int *x = bandit_arm(s, a), *y = bandit_arm(s, b);
+    for (int d = 0; d < s->n; d++) {
+        if (x[d] == y[d]) continue;
+        int right = s->preference_right ? s->preference_right[d] : 0;
+        return right ? x[d] > y[d] : x[d] < y[d];
+    }
+    return 0;
+}
+
+//whether arm a is better than arm b
+inline int bandit_better(const rtune_search_bandit_t *s, int a, int b) {
+    double ma = bandit_mean(s, a), mb = bandit_mean(s, b);
+    return ma < mb || (ma == mb && bandit_prefer(s, a, b));
+}
+
+//how often the values of arm a have been set
+inline long bandit_usage(const rtune_search_bandit_t *s, int a) {
+    if (!s->count_value) return 0;
+    long u = 0;
+    const int *x = bandit_arm(s, a);
+    for (int d = 0; d < s->n; d++) u += s->count_value[d] ? s->count_value[d][x[d]] : 0;
+    return u;
+}
+
+//draw num_arms distinct arms: all the configs of the product space if there are at most num_arms of them, otherwise random ones
+inline void bandit_draw(rtune_search_bandit_t *s, int num_arms) {
+    double total = 1.0;
+    for (int d = 0; d < s->n; d++) total *= s->num_values[d];
+    if (total <= num_arms) {
+        num_arms = (int) total;
+        for (int a = 0; a < num_arms; a++) {
+            int *x = bandit_arm(s, a);
+            int r = a;
+            for (int d = s->n - 1; d >= 0; d--) {
+                x[d] = r % s->num_values[d];
+                r /= s->num_values[d];
+            }
+        }
+        s->num_arms = num_arms;
+        return;
+    }
+    s->num_arms = 0;
+    while (s->num_arms < num_arms) {
+        int *x = bandit_arm(s, s->num_arms);
+        for (int d = 0; d < s->n; d++) x[d] = (int) (bandit_rand(s) % (uint64_t) s->num_values[d]);
+        int dup = 0;
+        for (int a = 0; a < s->num_arms && !dup; a++) {
+            dup = 1;
+            for (int d = 0; d < s->n && dup; d++) dup = bandit_arm(s, a)[d] == x[d];
+        }
+        if (!dup) s->num_arms++;
+    }
+}
+
+inline int bandit_num_rounds(int num_arms) {
+    int r = 0;
+    while ((1 << r) < num_arms) r++;
+    return r > 0 ? r : 1;
+}
+
+inline void bandit_halving_round(rtune_search_bandit_t *s) {
+    int rounds = bandit_num_rounds(s->num_alive);
+    int pulls = (s->budget - s->num_evaluations) / rounds / s->num_alive;
+    s->pulls = pulls > 0 ? pulls : 1;
+    s->cursor = 0;
+    s->pull = 0;
+    s->current = s->alive[0];
+}
+
+//pick the result. SUCCESSIVE_HALVING picks among the arms still alive: an eliminated arm lost a round, its mean of fewer samples
+//may be better only by luck
+inline void bandit_finish(rtune_search_bandit_t *s) {
+    int best = -1;
+    int num = s->ucb ? s->num_arms : s->num_alive;
+    for (int i = 0; i < num; i++) {
+        int a = s->ucb ? i : s->alive[i];
+        if (s->count[a] == 0) continue;
+        //UCB takes the most sampled arm, the mean is biased toward the arms that were lucky early
+        if (best < 0 || (s->ucb && s->count[a] > s->count[best])
+            || ((!s->ucb || s->count[a] == s->count[best]) && bandit_better(s, a, best))) best = a;
+    }
+    s->best = best >= 0 ? best : (s->ucb ? 0 : s->alive[0]);
+    s->converged = 1;
+}
+
+//the next UCB arm: an untried arm if any, the least used first, otherwise the arm with the lowest lower confidence bound
+inline int bandit_ucb_select(const rtune_search_bandit_t *s) {
+    int next = -1;
+    for (int a = 0; a < s->num_arms; a++) {
+        if (s->count[a] == 0 && (next < 0 || bandit_usage(s, a) < bandit_usage(s, next))) next = a;
+    }
+    if (next >= 0) return next;
+    double lo = HUGE_VAL, hi = -HUGE_VAL;
+    for (int a = 0; a < s->num_arms; a++) {
+        double m = bandit_mean(s, a);
+        lo = m < lo ? m : lo;
+        hi = m > hi ? m : hi;
+    }
+    double scale = s->exploration * (hi > lo ? hi - lo : 1.0);
+    double log_t = std::log((double) s->num_evaluations);
+    double best = HUGE_VAL;
+    for (int a = 0; a < s->num_arms; a++) {
+        double bound = bandit_mean(s, a) - scale * std::sqrt(2.0 * log_t / (double) s->count[a]);
+        if (next < 0 || bound < best || (bound == best && bandit_prefer(s, a, next))) {
+            best = bound;
+            next = a;
+        }
+    }
+    return next;
+}
+
+/**
+ * start the search with the budget, RTUNE_SEARCH_DEFAULT_BUDGET if it is 0. If the product space has at most max_arms configs,
+ * all of them are arms, and the default budget is capped at their number, so the search costs no more than an exhaustive
+ * pass (each evaluation already takes the samples of the fidelity window) and picks the best of the configs as it does; an
+ * explicit budget is kept and spent resampling the arms. Otherwise, for
+ * SUCCESSIVE_HALVING the number of arms is chosen so that every round samples each alive arm at least once, i.e.
+ * num_arms * log2(num_arms) <= budget, and for UCB each arm is sampled at least twice.
+ */
+inline void bandit_begin(rtune_search_bandit_t *s, int ucb, int budget, double exploration, uint64_t seed) {
+    double total = 1.0;
+    for (int d = 0; d < s->n; d++) total *= s->num_values[d];
+    int num_arms = s->max_arms;
+    int given = budget > 0;
+    if (!given) budget = RTUNE_SEARCH_DEFAULT_BUDGET;
+    if (total <= num_arms) {
+        num_arms = (int) total;
+        if (!given && budget > num_arms) budget = num_arms; //one pass over the space, an explicit budget is spent resampling
+    } else if (ucb) {
+        if (num_arms > budget / 2) num_arms = budget / 2;
+    } else {
+        while (num_arms > 2 && num_arms * bandit_num_rounds(num_arms) > budget) num_arms--;
+    }
+    if (num_arms < 1) num_arms = 1;
+    s->rng = seed ? seed : 0x9e3779b97f4a7c15ull;
+    bandit_draw(s, num_arms);
+    for (int a = 0; a < s->num_arms; a++) {
+        s->sum[a] = 0.0;
+        s->count[a] = 0;
+        s->alive[a] = a;
+    }
+    s->num_alive = s->num_arms;
+    s->ucb = ucb;
+    s->exploration = exploration;
+    s->budget = budget;
+    s->num_evaluations = 0;
+    s->converged = 0;
+    s->best = -1;
+    if (ucb) s->current = bandit_ucb_select(s);
+    else bandit_halving_round(s);
+    if (s->num_arms == 1) bandit_finish(s);
+}
+
+//fill point with the value indices to evaluate next and return 1, or return 0 if converged and bandit_arm(s, s->best) is the result
+inline int bandit_next(const rtune_search_bandit_t *s, int *point) {
+    if (s->converged) return 0;
+    const int *x = bandit_arm(s, s->current);
+    for (int d = 0; d < s->n; d++) point[d] = x[d];
+    return 1;
+}
+
+inline void bandit_report(rtune_search_bandit_t *s, double value) {
+    s->sum[s->current] += value;
+    s->count[s->current]++;
+    s->num_evaluations++;
+    if (s->num_evaluations >= s->budget) {
+        bandit_finish(s);
+        return;
+    }
+    if (s->ucb) {
+        s->current = bandit_ucb_select(s);
+        return;
+    }
+    if (++s->pull < s->pulls) return;
+    s->pull = 0;
+    if (++s->cursor < s->num_alive) {
+        s->current = s->alive[s->cursor];
+        return;
+    }
+    //end of the round: sort the alive arms (insertion sort) and keep the better half
+    for (int i = 1; i < s->num_alive; i++) {
+        int a = s->alive[i], j = i - 1;
+        for (; j >= 0 && bandit_better(s, a, s->alive[j]); j--) s->alive[j + 1] = s->alive[j];
+        s->alive[j + 1] = a;
+    }
+    s->num_alive = (s->num_alive + 1) / 2;
+    if (s->num_alive == 1) {
+        s->best = s->alive[0];
+        s->converged = 1;
+        return;
+    }
+    bandit_halving_round(s);
+}
+
+} // namespace search
+} // namespace rtune
+
+#endif
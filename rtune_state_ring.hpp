@@ -0,0 +1,151 @@
+#ifndef RTUNE_STATE_RING_HPP
+#define RTUNE_STATE_RING_HPP
+
+#include <cstddef>
+#include "rtune_api.h"
+
+/**
+ * @brief type-specialized kernels for the state ring of stvar_t, used by the runtime behind the C API.
+ *
+ * The type of a var/func is only checked once per call to dispatch(), e.g. once per batch, instead of once per state.
+ * The kernels themselves are branch-free loops over at most two contiguous segments of the ring, which the compiler
+ * can vectorize.
+ */
+namespace rtune {
+namespace detail {
+
+template <typename T> struct data_type;
+template <> struct data_type<short>  { static constexpr rtune_data_type_t value = RTUNE_short; };
+template <> struct data_type<int>    { static constexpr rtune_data_type_t value = RTUNE_int; };
+template <> struct data_type<long>   { static constexpr rtune_data_type_t value = RTUNE_long; };
+template <> struct data_type<float>  { static constexpr rtune_data_type_t value = RTUNE_float; };
+template <> struct data_type<double> { static constexpr rtune_data_type_t value = RTUNE_double; };
+
+//call f with a value-initialized T of the given type, e.g. dispatch(var->stvar.type, [&](auto tag) { using T = decltype(tag); ... });
+template <typename F>
+inline void dispatch(rtune_data_type_t type, F &&f) {
+    switch (type) {
+        case RTUNE_short:  f(short());  break;
+        case RTUNE_int:    f(int());    break;
+        case RTUNE_long:   f(long());   break;
+        case RTUNE_float:  f(float());  break;
+        case RTUNE_double: f(double()); break;
+        default: break;
+    }
+}
+
+template <typename T> inline T utype_get(const utype_t &u);
+template <> inline short  utype_get<short>(const utype_t &u)  { return u._short_value; }
+template <> inline int    utype_get<int>(const utype_t &u)    { return u._int_value; }
+template <> inline long   utype_get<long>(const utype_t &u)   { return u._long_value; }
+template <> inline float  utype_get<float>(const utype_t &u)  { return u._float_value; }
+template <> inline double utype_get<double>(const utype_t &u) { return u._double_value; }
+
+template <typename T> inline void utype_set(utype_t &u, T v);
+template <> inline void utype_set<short>(utype_t &u, short v)   { u._short_value = v; }
+template <> inline void utype_set<int>(utype_t &u, int v)       { u._int_value = v; }
+template <> inline void utype_set<long>(utype_t &u, long v)     { u._long_value = v; }
+template <> inline void utype_set<float>(utype_t &u, float v)   { u._float_value = v; }
+template <> inline void utype_set<double>(utype_t &u, double v) { u._double_value = v; }
+
+#define RTUNE_STATE_RING_MAX_CAPACITY (1u << 30) //total_num_states above it are clamped, the shift would overflow
+
+//capacity of the ring of total_num_states states, the power of two at or above it, in [1, RTUNE_STATE_RING_MAX_CAPACITY]
+inline unsigned int ring_capacity_for(int total_num_states) {
+    if (total_num_states > (int) RTUNE_STATE_RING_MAX_CAPACITY) return RTUNE_STATE_RING_MAX_CAPACITY;
+    unsigned int capacity = 1;
+    while (capacity < (unsigned int) (total_num_states > 0 ? total_num_states : 1)) capacity <<= 1;
+    return capacity;
+}
+
+//set up an empty ring over values, which has ring_capacity_for(total_num_states) elements of the type of the stvar
+inline void ring_init(rtune_state_ring_t *ring, void *values, int total_num_states) {
+    ring->values = values;
+    ring->capacity = ring_capacity_for(total_num_states);
+    ring->mask = ring->capacity - 1;
+    ring->head = 0;
+}
+
+template <typename T>
+inline T *ring_values(const rtune_state_ring_t *ring) {
+    return static_cast<T *>(ring->values);
+}
+
+inline unsigned int ring_size(const rtune_state_ring_t *ring) {
+    return ring->head < ring->capacity ? (unsigned int) ring->head : ring->capacity;
+}
+
+//slot of the ith most recent state, i=0 is the last state pushed
+inline unsigned int ring_slot_recent(const rtune_state_ring_t *ring, unsigned int i) {
+    return (unsigned int) (ring->head - 1 - i) & ring->mask;
+}
+
+template <typename T>
+inline void ring_push(rtune_state_ring_t *ring, T v) {
+    ring_values<T>(ring)[ring->head & ring->mask] = v;
+    ring->head++;
+}
+
+//append n contiguous states, e.g. the per-thread buffer of a concurrent region when it is merged
+template <typename T>
+inline void ring_push_n(rtune_state_ring_t *ring, const T *src, unsigned int n) {
+    T *values = ring_values<T>(ring);
+    if (n > ring->capacity) { //only the last capacity states survive
+        ring->head += n - ring->capacity;
+        src += n - ring->capacity;
+        n = ring->capacity;
+    }
+    unsigned int slot = ring->head & ring->mask;
+    unsigned int first = ring->capacity - slot < n ? ring->capacity - slot : n;
+    for (unsigned int i = 0; i < first; i++) values[slot + i] = src[i];
+    for (unsigned int i = first; i < n; i++) values[i - first] = src[i];
+    ring->head += n;
+}
+
+//sum of the n most recent states, accumulated in double
+template <typename T>
+inline double ring_sum_recent(const rtune_state_ring_t *ring, unsigned int n) {
+    const T *values = ring_values<T>(ring);
+    unsigned int size = ring_size(ring);
+    if (n > size) n = size;
+    unsigned int end = ring->head & ring->mask; //one past the last state
+    unsigned int second = end < n ? end : n;    //states in [end-second, end)
+    unsigned int first = n - second;            //states wrapped to the tail of the array
+    double sum = 0.0;
+    for (unsigned int i = end - second; i < end; i++) sum += values[i];
+    for (unsigned int i = ring->capacity - first; i < ring->capacity; i++) sum += values[i];
+    return sum;
+}
+
+//sum of n contiguous values, used for the per-thread buffers and the BATCH_ACCUMULATE accumulators
+template <typename T>
+inline T accumulate(const T *values, unsigned int n) {
+    T sum = T();
+    for (unsigned int i = 0; i < n; i++) sum += values[i];
+    return sum;
+}
+
+#define RTUNE_STATE_RING_NONE (~0u) //no state, e.g. the ring is empty
+
+//index (0 being the most recent) of the min or max of the n most recent states, RTUNE_STATE_RING_NONE if n or the ring is empty
+template <typename T, bool Max>
+inline unsigned int ring_arg_extreme_recent(const rtune_state_ring_t *ring, unsigned int n) {
+    const T *values = ring_values<T>(ring);
+    unsigned int size = ring_size(ring);
+    if (n > size) n = size;
+    if (n == 0) return RTUNE_STATE_RING_NONE;
+    unsigned int best = 0;
+    T best_v = values[ring_slot_recent(ring, 0)];
+    for (unsigned int i = 1; i < n; i++) {
+        T v = values[ring_slot_recent(ring, i)];
+        bool better = Max ? v > best_v : v < best_v;
+        best = better ? i : best;
+        best_v = better ? v : best_v;
+    }
+    return best;
+}
+
+} // namespace detail
+} // namespace rtune
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef RTUNE_TRACE_HPP
+#define RTUNE_TRACE_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rtune_api.h"
+
+/**
+ * @brief writer and reader of the binary trace files (RTUNE_TRACE_BINARY).
+ *
+ * A writer is owned by one thread. Appending a record is a store into the mapping and an update of num_records in
+ * the header; the file is only remapped, by doubling, when it is full.
+ */
+namespace rtune {
+namespace trace {
+
+inline size_t file_size(uint64_t capacity) {
+    return sizeof(rtune_trace_header_t) + capacity * sizeof(rtune_trace_record_t);
+}
+
+inline int writer_map(rtune_trace_file_t *tf, uint64_t capacity) {
+    if (ftruncate(tf->fd, (off_t) file_size(capacity)) != 0) return -1;
+    void *p = mmap(NULL, file_size(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, tf->fd, 0);
+    if (p == MAP_FAILED) return -1;
+    tf->header = (rtune_trace_header_t *) p;
+    tf->records = (rtune_trace_record_t *) (tf->header + 1);
+    tf->capacity = capacity;
+    return 0;
+}
+
+//create the trace file of a thread, return 0 on success and -1 on error (errno is set)
+inline int writer_open(rtune_trace_file_t *tf, const char *prefix, uint32_t thread_id) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.%u.rtt", prefix, thread_id);
+    tf->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (tf->fd < 0) return -1;
+    if (writer_map(tf, RTUNE_TRACE_INIT_NUM_RECORDS) != 0) {
+        close(tf->fd);
+        tf->fd = -1;
+        return -1;
+    }
+    tf->header->magic = RTUNE_TRACE_MAGIC;
+    tf->header->version = RTUNE_TRACE_VERSION;
+    tf->header->record_size = sizeof(rtune_trace_record_t);
+    tf->header->thread_id = thread_id;
+    tf->header->num_records = 0;
+    return 0;
+}
+
+//double the capacity. The old mapping is only unmapped once the new one is in place, so on error the writer is unchanged
+//(the file may have been extended, writer_close truncates it to the records written)
+inline int writer_grow(rtune_trace_file_t *tf) {
+    rtune_trace_header_t *old = tf->header;
+    uint64_t capacity = tf->capacity;
+    if (writer_map(tf, capacity * 2) != 0) return -1;
+    munmap(old, file_size(capacity));
+    return 0;
+}
+
+inline int writer_append(rtune_trace_file_t *tf, const rtune_trace_record_t *record) {
+    uint64_t n = tf->header->num_records;
+    if (n == tf->capacity && writer_grow(tf) != 0) return -1;
+    tf->records[n] = *record;
+    tf->header->num_records = n + 1;
+    return 0;
+}
+
+inline void writer_flush(rtune_trace_file_t *tf) {
+    msync(tf->header, file_size(tf->capacity), MS_ASYNC);
+}
+
+//unmap and truncate the file to the records that have been written
+inline void writer_close(rtune_trace_file_t *tf) {
+    uint64_t n = tf->header->num_records;
+    munmap(tf->header, file_size(tf->capacity));
+    if (ftruncate(tf->fd, (off_t) file_size(n)) != 0) perror("rtune trace truncate");
+    close(tf->fd);
+    tf->fd = -1;
+    tf->header = NULL;
+    tf->records = NULL;
+}
+
+/**
+ * read-only view of a trace file. A file that is still being written can be read as well, only the records
+ * up to num_records at the time of open are visible.
+ */
+class reader {
+public:
+    reader() = default;
+    reader(const reader &) = delete;
+    reader &operator=(const reader &) = delete;
+    ~reader() { close(); }
+
+    //return 0 on success, -1 if the file cannot be mapped or is not a trace file
+    int open(const char *path) {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return -1;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(rtune_trace_header_t)) {
+            ::close(fd);
+            return -1;
+        }
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return -1;
+        base_ = p;
+        size_ = st.st_size;
+        const rtune_trace_header_t *h = header();
+        if (h->magic != RTUNE_TRACE_MAGIC || h->version != RTUNE_TRACE_VERSION || h->record_size != sizeof(rtune_trace_record_t)) {
+            close();
+            return -1;
+        }
+        num_records_ = h->num_records;
+        uint64_t max_records = (size_ - sizeof(rtune_trace_header_t)) / sizeof(rtune_trace_record_t);
+        if (num_records_ > max_records) num_records_ = max_records;
+        return 0;
+    }
+
+    void close() {
+        if (base_) munmap(base_, size_);
+        base_ = NULL;
+        size_ = 0;
+        num_records_ = 0;
+    }
+
+    const rtune_trace_header_t *header() const { return (const rtune_trace_header_t *) base_; }
+    uint64_t size() const { return num_records_; }
+    const rtune_trace_record_t *begin() const { return (const rtune_trace_record_t *) (header() + 1); }
+    const rtune_trace_record_t *end() const { return begin() + num_records_; }
+    const rtune_trace_record_t &operator[](uint64_t i) const { return begin()[i]; }
+
+private:
+    void *base_ = NULL;
+    size_t size_ = 0;
+    uint64_t num_records_ = 0;
+};
+
+inline void print_value(FILE *out, uint16_t type, const utype_t &v) {
+    switch (type) {
+        case RTUNE_short:  fprintf(out, "%hd", v._short_value); break;
+        case RTUNE_int:    fprintf(out, "%d", v._int_value); break;
+        case RTUNE_long:   fprintf(out, "%ld", v._long_value); break;
+        case RTUNE_float:  fprintf(out, "%g", v._float_value); break;
+        case RTUNE_double: fprintf(out, "%.17g", v._double_value); break;
+        default: break;
+    }
+}
+
+inline const char *record_kind_name(uint16_t kind) {
+    switch (kind) {
+        case RTUNE_TRACE_RECORD_VAR: return "var";
+        case RTUNE_TRACE_RECORD_FUNC: return "func";
+        case RTUNE_TRACE_RECORD_OBJECTIVE: return "objective";
+        default: return "unknown";
+    }
+}
+
+inline void csv_header(FILE *out) {
+    fprintf(out, "thread,region,iteration,kind,id,state_index,value,old_status,new_status\n");
+}
+
+inline void csv_write(FILE *out, const reader &r) {
+    uint32_t thread_id = r.header()->thread_id;
+    for (const rtune_trace_record_t *rec = r.begin(); rec != r.end(); rec++) {
+        fprintf(out, "%u,%u,%u,%s,%u,", thread_id, rec->region_id, rec->iteration, record_kind_name(rec->kind), rec->id);
+        if (rec->kind == RTUNE_TRACE_RECORD_OBJECTIVE) {
+            fputc(',', out);
+            print_value(out, rec->type, rec->value);
+            fprintf(out, ",%d,%u\n", rec->state_index, rec->status);
+        } else {
+            fprintf(out, "%d,", rec->state_index);
+            print_value(out, rec->type, rec->value);
+            fprintf(out, ",,\n");
+        }
+    }
+}
+
+} // namespace trace
+} // namespace rtune
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef RTUNE_TEST_H
+#define RTUNE_TEST_H
+
+/**
+ * @brief minimal check macro of the tests: report the failed condition with its location and exit with 1.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RTUNE_CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+#endif
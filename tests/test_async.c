@@ -0,0 +1,160 @@
+/**
+ * tests of the asynchronous mode: the bounded MPMC sample queue with several producers and the worker popping concurrently
+ * (no sample lost or duplicated, the samples of a producer popped in order), the accounting of the samples dropped when the
+ * queue is full, and the configuration snapshots read by several threads while the worker publishes in a loop.
+ */
+#include "rtune_async.h"
+#include <pthread.h>
+#include <sched.h>
+#include "rtune_test.h"
+
+#define NUM_PRODUCERS 4
+#define PER_PRODUCER 20000
+#define NUM_VALUES 2
+#define QUEUE_CAPACITY 64
+
+typedef struct producer {
+    rtune_async_queue_t *q;
+    int thread;
+    long num_full; //pushes that found the queue full and were retried
+} producer_t;
+
+static void *produce(void *arg) {
+    producer_t *p = (producer_t *) arg;
+    for (int i = 0; i < PER_PRODUCER; i++) {
+        utype_t values[NUM_VALUES];
+        values[0]._int_value = p->thread;
+        values[1]._int_value = i;
+        while (rtune_async_push(p->q, i, p->thread, (uint64_t) i * 2, values) != 0) {
+            p->num_full++;
+            sched_yield(); //let the worker run on a machine with few cores
+        }
+    }
+    return NULL;
+}
+
+static void test_queue_producers(void) {
+    rtune_async_slot_t slots[QUEUE_CAPACITY];
+    utype_t values[QUEUE_CAPACITY * NUM_VALUES];
+    rtune_async_queue_t q;
+    rtune_async_queue_init(&q, QUEUE_CAPACITY, NUM_VALUES, slots, values);
+
+    pthread_t threads[NUM_PRODUCERS];
+    producer_t producers[NUM_PRODUCERS];
+    for (int t = 0; t < NUM_PRODUCERS; t++) {
+        producers[t].q = &q;
+        producers[t].thread = t;
+        producers[t].num_full = 0;
+        RTUNE_CHECK(pthread_create(&threads[t], NULL, produce, &producers[t]) == 0);
+    }
+    //the worker pops while the producers push
+    int next[NUM_PRODUCERS] = {0};
+    for (long n = 0; n < (long) NUM_PRODUCERS * PER_PRODUCER;) {
+        rtune_async_slot_t sample;
+        utype_t v[NUM_VALUES];
+        if (rtune_async_pop(&q, &sample, v) != 0) {
+            sched_yield();
+            continue;
+        }
+        int t = sample.thread;
+        RTUNE_CHECK(t >= 0 && t < NUM_PRODUCERS);
+        RTUNE_CHECK(sample.iteration == next[t] && sample.config_version == (uint64_t) next[t] * 2);
+        RTUNE_CHECK(v[0]._int_value == t && v[1]._int_value == next[t]);
+        next[t]++;
+        n++;
+    }
+    long num_full = 0;
+    for (int t = 0; t < NUM_PRODUCERS; t++) {
+        pthread_join(threads[t], NULL);
+        RTUNE_CHECK(next[t] == PER_PRODUCER);
+        num_full += producers[t].num_full;
+    }
+    rtune_async_slot_t sample;
+    utype_t v[NUM_VALUES];
+    RTUNE_CHECK(rtune_async_pop(&q, &sample, v) == -1);
+    RTUNE_CHECK(q.num_dropped == (uint64_t) num_full);
+}
+
+static void test_queue_full(void) {
+    rtune_async_slot_t slots[8];
+    utype_t values[8];
+    rtune_async_queue_t q;
+    rtune_async_queue_init(&q, 8, 1, slots, values);
+    utype_t v;
+    for (int i = 0; i < 8; i++) {
+        v._int_value = i;
+        RTUNE_CHECK(rtune_async_push(&q, i, 0, 0, &v) == 0);
+    }
+    for (int i = 0; i < 4; i++) {
+        v._int_value = 100 + i;
+        RTUNE_CHECK(rtune_async_push(&q, 100 + i, 0, 0, &v) == -1);
+    }
+    RTUNE_CHECK(q.num_dropped == 4);
+
+    //a pop frees one slot, the dropped samples are not in the queue
+    rtune_async_slot_t sample;
+    RTUNE_CHECK(rtune_async_pop(&q, &sample, &v) == 0 && sample.iteration == 0 && v._int_value == 0);
+    v._int_value = 8;
+    RTUNE_CHECK(rtune_async_push(&q, 8, 0, 0, &v) == 0);
+    RTUNE_CHECK(rtune_async_push(&q, 9, 0, 0, &v) == -1 && q.num_dropped == 5);
+    for (int i = 1; i <= 8; i++) RTUNE_CHECK(rtune_async_pop(&q, &sample, &v) == 0 && sample.iteration == i && v._int_value == i);
+    RTUNE_CHECK(rtune_async_pop(&q, &sample, &v) == -1);
+}
+
+#define NUM_READERS 3
+#define SNAPSHOT_VARS 16
+#define NUM_PUBLISHES 100000
+
+typedef struct snapshot_test {
+    rtune_config_snapshot_t *current;
+    int done;
+} snapshot_test_t;
+
+//every var of the snapshot k is k, so a torn copy has two different values
+static void *read_snapshots(void *arg) {
+    snapshot_test_t *st = (snapshot_test_t *) arg;
+    uint64_t applied = 0;
+    int last = -1, index[SNAPSHOT_VARS];
+    while (!__atomic_load_n(&st->done, __ATOMIC_ACQUIRE)) {
+        if (!rtune_config_read(&st->current, &applied, index, SNAPSHOT_VARS)) {
+            sched_yield();
+            continue;
+        }
+        for (int i = 1; i < SNAPSHOT_VARS; i++) RTUNE_CHECK(index[i] == index[0]);
+        RTUNE_CHECK(index[0] > last && (applied & 1) == 0);
+        last = index[0];
+    }
+    RTUNE_CHECK(rtune_config_read(&st->current, &applied, index, SNAPSHOT_VARS) == 1 || last == NUM_PUBLISHES - 1);
+    return NULL;
+}
+
+static void test_snapshots(void) {
+    int storage[RTUNE_ASYNC_NUM_SNAPSHOTS][SNAPSHOT_VARS];
+    rtune_config_snapshot_t snapshots[RTUNE_ASYNC_NUM_SNAPSHOTS];
+    for (int s = 0; s < RTUNE_ASYNC_NUM_SNAPSHOTS; s++) {
+        snapshots[s].version = 0;
+        snapshots[s].index = storage[s];
+    }
+    snapshot_test_t st = {NULL, 0};
+    int index[SNAPSHOT_VARS];
+    for (int i = 0; i < SNAPSHOT_VARS; i++) index[i] = 0;
+    rtune_config_publish(&st.current, snapshots, index, SNAPSHOT_VARS);
+
+    pthread_t threads[NUM_READERS];
+    for (int t = 0; t < NUM_READERS; t++) RTUNE_CHECK(pthread_create(&threads[t], NULL, read_snapshots, &st) == 0);
+    for (int k = 1; k < NUM_PUBLISHES; k++) {
+        for (int i = 0; i < SNAPSHOT_VARS; i++) index[i] = k;
+        rtune_config_publish(&st.current, snapshots, index, SNAPSHOT_VARS);
+        if (k % 16 == 0) sched_yield(); //let the readers run on a machine with few cores
+    }
+    __atomic_store_n(&st.done, 1, __ATOMIC_RELEASE);
+    for (int t = 0; t < NUM_READERS; t++) pthread_join(threads[t], NULL);
+    RTUNE_CHECK(st.current->version == 2 * (uint64_t) NUM_PUBLISHES && st.current->index[0] == NUM_PUBLISHES - 1);
+}
+
+int main(void) {
+    test_queue_full();
+    test_queue_producers();
+    test_snapshots();
+    return 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * tests of the persistent tuning cache: store and lookup, and recovery from a writer that crashed in the middle of an
+ * entry (seq left odd, with or without the file lock held when it died).
+ */
+#include "rtune_cache.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include "rtune_test.h"
+
+static char path[] = "/tmp/rtune_test_cache.XXXXXX";
+
+static rtune_cache_entry_t *entry_of(rtune_cache_t *cache, uint64_t key) {
+    return &cache->entries[key & (cache->header->num_entries - 1)];
+}
+
+static void test_store_lookup(rtune_cache_t *cache) {
+    int index[3] = {4, 1, 7};
+    rtune_cache_entry_t e;
+    RTUNE_CHECK(rtune_cache_lookup(cache, 42, &e) == -1);
+    RTUNE_CHECK(rtune_cache_store(cache, 42, index, 3, 2.5) == 0);
+    RTUNE_CHECK(rtune_cache_lookup(cache, 42, &e) == 0);
+    RTUNE_CHECK(e.num_vars == 3 && e.index[0] == 4 && e.index[2] == 7 && e.value == 2.5 && (e.seq & 1) == 0);
+    RTUNE_CHECK(rtune_cache_store(cache, 42, index, RTUNE_CACHE_MAX_VARS + 1, 2.5) == -1);
+}
+
+//a writer died with seq odd: the lookup misses instead of spinning, and the next writer reclaims the entry
+static void test_stuck_seq(rtune_cache_t *cache) {
+    rtune_cache_entry_t *stuck = entry_of(cache, 42);
+    __atomic_store_n(&stuck->seq, stuck->seq + 1, __ATOMIC_RELEASE);
+    rtune_cache_entry_t e;
+    RTUNE_CHECK(rtune_cache_lookup(cache, 42, &e) == -1);
+    int index[3] = {5, 2, 8};
+    RTUNE_CHECK(rtune_cache_store(cache, 42, index, 3, 1.5) == 0);
+    RTUNE_CHECK((stuck->seq & 1) == 0);
+    RTUNE_CHECK(rtune_cache_lookup(cache, 42, &e) == 0 && e.index[0] == 5 && e.value == 1.5);
+}
+
+//another process is killed while it holds the lock and writes an entry
+static void test_crashed_writer(rtune_cache_t *cache) {
+    int ready[2];
+    RTUNE_CHECK(pipe(ready) == 0);
+    pid_t pid = fork();
+    RTUNE_CHECK(pid >= 0);
+    if (pid == 0) {
+        rtune_cache_t c;
+        if (rtune_cache_map(&c, path, 16) != 0 || rtune_cache_flock(c.fd, LOCK_EX) != 0) _exit(1);
+        rtune_cache_entry_t *e = entry_of(&c, 99);
+        uint64_t zero = 0;
+        __atomic_compare_exchange_n(&e->key, &zero, 99, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&e->seq, 1, __ATOMIC_RELEASE);
+        if (write(ready[1], "x", 1) != 1) _exit(1);
+        for (;;) pause();
+    }
+    char x;
+    RTUNE_CHECK(read(ready[0], &x, 1) == 1);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    close(ready[0]);
+    close(ready[1]);
+
+    rtune_cache_entry_t e;
+    RTUNE_CHECK(rtune_cache_lookup(cache, 99, &e) == -1);
+    int index[1] = {3};
+    RTUNE_CHECK(rtune_cache_store(cache, 99, index, 1, 7.0) == 0);
+    RTUNE_CHECK(rtune_cache_lookup(cache, 99, &e) == 0 && e.num_vars == 1 && e.index[0] == 3 && e.value == 7.0);
+}
+
+int main(void) {
+    int fd = mkstemp(path);
+    RTUNE_CHECK(fd >= 0);
+    close(fd);
+    rtune_cache_t cache;
+    RTUNE_CHECK(rtune_cache_map(&cache, path, 16) == 0);
+    RTUNE_CHECK(cache.header->num_entries == 16);
+    test_store_lookup(&cache);
+    test_stuck_seq(&cache);
+    test_crashed_writer(&cache);
+    rtune_cache_unmap(&cache);
+    unlink(path);
+    return 0;
+}
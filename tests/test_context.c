@@ -0,0 +1,137 @@
+/**
+ * tests of the context buckets: each bucket keeps its own copy of the search arrays, so moving between buckets neither
+ * loses the arrays of the objective nor mixes the searches of two buckets, and a bucket between two met buckets starts its
+ * search from their interpolated config.
+ */
+#include "rtune_context.h"
+#include "rtune_test.h"
+
+enum { NUM_VARS = 2, NUM_BUCKETS = 4, MAX_ARMS = 8 };
+
+typedef struct fixture {
+    rtune_arena_t arena;
+    rtune_objective_t obj;
+    struct config config[NUM_VARS];
+    rtune_var_t ctx;
+    rtune_context_bucket_t buckets[NUM_BUCKETS];
+    int indices[NUM_BUCKETS * NUM_VARS];
+    int num_values[NUM_VARS];
+} fixture_t;
+
+static void setup(fixture_t *f, rtune_objective_search_strategy_t strategy) {
+    memset(f, 0, sizeof(*f));
+    f->num_values[0] = f->num_values[1] = 16;
+    f->obj.num_vars = NUM_VARS;
+    f->obj.config = f->config;
+    f->obj.search_strategy = strategy;
+    f->ctx.stvar.type = RTUNE_int;
+    if (strategy == RTUNE_OBJECTIVE_SEARCH_NELDER_MEAD) {
+        rtune_search_simplex_t *s = &f->obj.search_state.simplex;
+        s->n = NUM_VARS;
+        s->num_values = f->num_values;
+        s->vertices = (int *) rtune_arena_alloc(&f->arena, sizeof(int) * (NUM_VARS + 1) * NUM_VARS);
+        s->values = (double *) rtune_arena_alloc(&f->arena, sizeof(double) * (NUM_VARS + 1));
+        s->trial = (int *) rtune_arena_alloc(&f->arena, sizeof(int) * NUM_VARS);
+        s->reflect = (int *) rtune_arena_alloc(&f->arena, sizeof(int) * NUM_VARS);
+    } else {
+        rtune_search_bandit_t *s = &f->obj.search_state.bandit;
+        s->n = NUM_VARS;
+        s->num_values = f->num_values;
+        s->max_arms = MAX_ARMS;
+        s->arms = (int *) rtune_arena_alloc(&f->arena, sizeof(int) * MAX_ARMS * NUM_VARS);
+        s->sum = (double *) rtune_arena_alloc(&f->arena, sizeof(double) * MAX_ARMS);
+        s->count = (long *) rtune_arena_alloc(&f->arena, sizeof(long) * MAX_ARMS);
+        s->alive = (int *) rtune_arena_alloc(&f->arena, sizeof(int) * MAX_ARMS);
+    }
+    RTUNE_CHECK(rtune_context_setup(&f->obj, &f->ctx, RTUNE_CONTEXT_LINEAR, 0.0, 400.0, NUM_BUCKETS, 0, f->buckets, f->indices) == 0);
+    RTUNE_CHECK(rtune_context_alloc_search(&f->arena, &f->obj) == 0);
+}
+
+static int move_to(fixture_t *f, int value) {
+    f->ctx.stvar.v._int_value = value;
+    return rtune_context_update(&f->obj);
+}
+
+static void test_simplex(void) {
+    fixture_t f;
+    setup(&f, RTUNE_OBJECTIVE_SEARCH_NELDER_MEAD);
+    rtune_search_simplex_t *s = &f.obj.search_state.simplex;
+    int *vertices = s->vertices;
+
+    RTUNE_CHECK(move_to(&f, 50) == 1);
+    RTUNE_CHECK(s->vertices == vertices && s->trial && s->n == NUM_VARS && s->num_values == f.num_values);
+    s->vertices[0] = 3;
+    s->values[1] = 1.5;
+    s->num_evaluations = 5;
+
+    //a new bucket starts a new search with the arrays of the objective
+    RTUNE_CHECK(move_to(&f, 250) == 1);
+    RTUNE_CHECK(s->vertices == vertices && s->num_evaluations == 0 && s->n == NUM_VARS);
+    s->vertices[0] = 7;
+    s->num_evaluations = 2;
+
+    //the search of the first bucket is continued where it was left, the second one is not overwritten
+    RTUNE_CHECK(move_to(&f, 60) == 0);
+    RTUNE_CHECK(s->vertices == vertices && s->vertices[0] == 3 && s->values[1] == 1.5 && s->num_evaluations == 5);
+    RTUNE_CHECK(move_to(&f, 260) == 0);
+    RTUNE_CHECK(s->vertices[0] == 7 && s->num_evaluations == 2);
+    RTUNE_CHECK(f.buckets[0].search_state.simplex.vertices != vertices && f.buckets[0].search_state.simplex.vertices[0] == 3);
+    rtune_arena_free(&f.arena);
+}
+
+static void test_bandit(void) {
+    fixture_t f;
+    setup(&f, RTUNE_OBJECTIVE_SEARCH_UCB);
+    rtune_search_bandit_t *s = &f.obj.search_state.bandit;
+    int *arms = s->arms;
+
+    RTUNE_CHECK(move_to(&f, 10) == 1);
+    s->num_arms = 2;
+    s->arms[2] = 9;
+    s->count[1] = 4;
+    RTUNE_CHECK(move_to(&f, 390) == 1);
+    RTUNE_CHECK(s->arms == arms && s->num_arms == 0 && s->max_arms == MAX_ARMS && s->count);
+    s->num_arms = 1;
+    s->arms[2] = 1;
+    RTUNE_CHECK(move_to(&f, 10) == 0);
+    RTUNE_CHECK(s->arms == arms && s->num_arms == 2 && s->arms[2] == 9 && s->count[1] == 4);
+    rtune_arena_free(&f.arena);
+}
+
+//meet the active bucket with the config index0, index1
+static void meet(fixture_t *f, int index0, int index1, double value) {
+    f->obj.config[0].index = index0;
+    f->obj.config[1].index = index1;
+    f->obj.status = RTUNE_STATUS_OBJECTIVE_MET;
+    rtune_context_met(&f->obj, value);
+}
+
+static void test_interpolate(void) {
+    fixture_t f;
+    setup(&f, RTUNE_OBJECTIVE_SEARCH_SUCCESSIVE_HALVING);
+    f.obj.context_interpolate = 1;
+    RTUNE_CHECK(move_to(&f, 50) == 1);
+    meet(&f, 2, 4, 10.0);
+    RTUNE_CHECK(move_to(&f, 250) == 1);
+    meet(&f, 6, 8, 20.0);
+
+    //bucket 1 is between the met buckets 0 and 2: it is sampled from their interpolated config, it has no value yet
+    RTUNE_CHECK(move_to(&f, 150) == 1);
+    RTUNE_CHECK(f.buckets[1].status == RTUNE_STATUS_SAMPLING && f.obj.status == RTUNE_STATUS_SAMPLING && isnan(f.buckets[1].value));
+    RTUNE_CHECK(f.obj.config[0].index == 4 && f.obj.config[1].index == 6);
+    meet(&f, 5, 6, 15.0);
+    RTUNE_CHECK(f.buckets[1].status == RTUNE_STATUS_OBJECTIVE_MET && f.buckets[1].value == 15.0);
+    RTUNE_CHECK(f.buckets[0].value == 10.0 && f.buckets[2].value == 20.0);
+
+    //back to a met bucket: its config is applied as is
+    RTUNE_CHECK(move_to(&f, 50) == 0);
+    RTUNE_CHECK(f.obj.status == RTUNE_STATUS_OBJECTIVE_MET && f.obj.config[0].index == 2 && f.obj.config[1].index == 4);
+    rtune_arena_free(&f.arena);
+}
+
+int main(void) {
+    test_simplex();
+    test_bandit();
+    test_interpolate();
+    return 0;
+}
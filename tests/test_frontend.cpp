@@ -0,0 +1,90 @@
+/**
+ * tests of the C++ front end of rtune.hpp against a stub of the C API: the vars are allocated by the stub, and the runtime
+ * applying a value is simulated by calling the applier of the var with the address of its value, as the runtime does.
+ */
+#include <memory>
+#include <vector>
+#include "rtune_test.h"
+#include "rtune.hpp"
+
+//stub of the C API used by the tests, a region only holds its vars
+static std::vector<std::unique_ptr<rtune_var_t>> stub_vars;
+static int stub_num_regions = 0;
+
+extern "C" {
+rtune_region_t *rtune_region_init(char *) {
+    stub_num_regions++;
+    return reinterpret_cast<rtune_region_t *>(&stub_num_regions);
+}
+void rtune_region_fini(rtune_region_t *) { stub_num_regions--; }
+void rtune_regin_begin(rtune_region_t *) {}
+void rtune_region_end(rtune_region_t *) {}
+
+void *rtune_var_add_range(rtune_region_t *, char *name, int total_num_states, rtune_data_type_t type, void *begin, void *, void *) {
+    stub_vars.emplace_back(new rtune_var_t());
+    rtune_var_t *v = stub_vars.back().get();
+    v->stvar.name = name;
+    v->stvar.type = type;
+    v->stvar.total_num_states = total_num_states;
+    v->stvar.v = *static_cast<utype_t *>(begin);
+    return v;
+}
+void rtune_var_set_applier_policy(rtune_var_t *var, void *(*applier)(void *), rtune_var_apply_policy_t apply_policy) {
+    var->stvar.applier = applier;
+    var->apply_policy = apply_policy;
+}
+}
+
+static void apply(rtune_var_t *v, int value) {
+    v->stvar.v._int_value = value;
+    v->stvar.applier(&v->stvar.v);
+}
+
+//the same lambda expression set as the applier of several vars: each var calls its own lambda object
+static void test_applier_per_var() {
+    rtune::region r("frontend");
+    std::vector<int> applied(3, -1);
+    std::vector<rtune::var<int>> vars;
+    for (int i = 0; i < 3; i++) {
+        vars.push_back(r.add_range<int>("v", 0, 10, 1));
+        r.set_applier(vars[i], [&applied, i](int value) { applied[i] = value; });
+    }
+    apply(vars[0].get(), 4);
+    apply(vars[2].get(), 7);
+    RTUNE_CHECK(applied[0] == 4 && applied[1] == -1 && applied[2] == 7);
+    RTUNE_CHECK(vars[2].value() == 7 && vars[0].get()->apply_policy == RTUNE_VAR_APPLY_ON_UPDATE);
+}
+
+//an applier whose region has been destroyed is not called by the vars of a later region
+static void test_applier_region_lifetime() {
+    int first = 0, second = 0;
+    auto make = [](int *count) { return [count](int) { (*count)++; }; };
+    {
+        rtune::region r("first");
+        auto v = r.add_range<int>("v", 0, 10, 1);
+        r.set_applier(v, make(&first));
+        apply(v.get(), 1);
+    }
+    rtune::region r("second");
+    auto v = r.add_range<int>("v", 0, 10, 1);
+    r.set_applier(v, make(&second));
+    apply(v.get(), 2);
+    RTUNE_CHECK(first == 1 && second == 1 && stub_num_regions == 1);
+}
+
+static void test_range_step() {
+    rtune::region r("range");
+    size_t num_vars = stub_vars.size();
+    auto v = r.add_range<int>("zero", 0, 10, 0);
+    RTUNE_CHECK(!v.get() && stub_vars.size() == num_vars);
+    r.set_applier(v, [](int) {}); //ignored on a null handle
+    auto w = r.add_range<double>("half", 0.0, 2.0, 0.5);
+    RTUNE_CHECK(w.get() && w.get()->stvar.total_num_states == 5);
+}
+
+int main() {
+    test_applier_per_var();
+    test_applier_region_lifetime();
+    test_range_step();
+    return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * tests of the compiled func graph: a linear func reads its coefficient vars from their registers, the first load of a
+ * coefficient marks it dirty whatever its value, GRADIENT starts at 0, and a region with an input that is not in the region
+ * or with more registers than the instructions can address is not compiled.
+ */
+#include "rtune_func_program.h"
+#include "rtune_test.h"
+
+enum { X, C0, C1, Y, NUM_VARS };
+enum { LIN, GRAD, NUM_FUNCS };
+
+static void load(rtune_func_program_t *prog, int reg, const double *values, int n) {
+    for (int k = 0; k < n; k++) rtune_func_program_reg(prog, reg)[k] = values[k];
+    rtune_func_program_mark_dirty(prog, reg);
+}
+
+int main(void) {
+    rtune_region_t *region = rtune_region_alloc();
+    RTUNE_CHECK(region != NULL);
+    rtune_arena_t *a = &region->arena;
+    region->num_vars = NUM_VARS;
+    region->num_funcs = NUM_FUNCS;
+    region->vars = (rtune_var_t **) rtune_arena_alloc(a, sizeof(rtune_var_t *) * NUM_VARS);
+    region->funcs = (rtune_func_t **) rtune_arena_alloc(a, sizeof(rtune_func_t *) * NUM_FUNCS);
+    for (int i = 0; i < NUM_VARS; i++) region->vars[i] = (rtune_var_t *) rtune_arena_alloc(a, sizeof(rtune_var_t));
+    for (int j = 0; j < NUM_FUNCS; j++) region->funcs[j] = (rtune_func_t *) rtune_arena_alloc(a, sizeof(rtune_func_t));
+
+    //lin = c0 + c1 * x, grad = gradient(y)
+    rtune_func_t *lin = region->funcs[LIN], *grad = region->funcs[GRAD];
+    lin->kind = RTUNE_FUNC;
+    lin->num_vars = 1;
+    lin->num_coefficients = 2;
+    lin->input_varcoefs = (rtune_var_t **) rtune_arena_alloc(a, sizeof(rtune_var_t *) * 3);
+    lin->input_varcoefs[0] = region->vars[X];
+    lin->input_varcoefs[1] = region->vars[C0];
+    lin->input_varcoefs[2] = region->vars[C1];
+    grad->kind = RTUNE_FUNC_GRADIENT;
+    grad->num_vars = 1;
+    grad->input_varcoefs = (rtune_var_t **) rtune_arena_alloc(a, sizeof(rtune_var_t *));
+    grad->input_varcoefs[0] = region->vars[Y];
+
+    rtune_func_program_t prog;
+    RTUNE_CHECK(rtune_func_program_compile(&prog, region, 4) == 0);
+    RTUNE_CHECK(prog.num_groups == 2 && prog.num_insns == 3);
+    const double *out_lin = rtune_func_program_reg(&prog, NUM_VARS + LIN);
+    const double *out_grad = rtune_func_program_reg(&prog, NUM_VARS + GRAD);
+
+    double x[3] = {1, 2, 3}, y[3] = {5, 7, 8};
+    prog.batch_size = 3;
+    load(&prog, X, x, 3);
+    load(&prog, Y, y, 3);
+    rtune_func_program_load_const(&prog, C0, 10.0);
+    rtune_func_program_load_const(&prog, C1, 2.0);
+    rtune_func_program_eval(&prog);
+    RTUNE_CHECK(out_lin[0] == 12.0 && out_lin[1] == 14.0 && out_lin[2] == 16.0);
+    RTUNE_CHECK(out_grad[0] == 0.0 && out_grad[1] == 2.0 && out_grad[2] == 1.0);
+    rtune_func_program_end_batch(&prog);
+
+    //only a coefficient changes: lin is recomputed with it, grad is not
+    rtune_func_program_load_const(&prog, C0, 10.0);
+    rtune_func_program_load_const(&prog, C1, 3.0);
+    RTUNE_CHECK(!rtune_func_program_is_dirty(&prog, C0) && rtune_func_program_is_dirty(&prog, C1));
+    rtune_func_program_eval(&prog);
+    RTUNE_CHECK(out_lin[0] == 13.0 && out_lin[1] == 16.0 && out_lin[2] == 19.0);
+    RTUNE_CHECK(rtune_func_program_is_dirty(&prog, NUM_VARS + LIN) && !rtune_func_program_is_dirty(&prog, NUM_VARS + GRAD));
+    rtune_func_program_end_batch(&prog);
+
+    //the gradient continues from the last state of the previous batch
+    double y2[1] = {10};
+    prog.batch_size = 1;
+    load(&prog, Y, y2, 1);
+    rtune_func_program_eval(&prog);
+    RTUNE_CHECK(out_grad[0] == 2.0);
+
+    //0.0 is loaded into a register of a new program, whose memory may already hold 0.0
+    RTUNE_CHECK(rtune_func_program_compile(&prog, region, 4) == 0);
+    rtune_func_program_load_const(&prog, C0, 0.0);
+    RTUNE_CHECK(rtune_func_program_is_dirty(&prog, C0));
+    rtune_func_program_end_batch(&prog);
+    rtune_func_program_load_const(&prog, C0, 0.0);
+    RTUNE_CHECK(!rtune_func_program_is_dirty(&prog, C0));
+
+    //an input that is not a var or func of the region
+    rtune_var_t outside;
+    grad->input_varcoefs[0] = &outside;
+    RTUNE_CHECK(rtune_func_program_compile(&prog, region, 4) == -1);
+    grad->input_varcoefs[0] = region->vars[Y];
+
+    //registers are uint16_t
+    region->num_vars = RTUNE_FUNC_MAX_REGS;
+    RTUNE_CHECK(rtune_func_program_compile(&prog, region, 4) == -1);
+    rtune_region_free(region);
+    return 0;
+}
@@ -0,0 +1,24 @@
+/**
+ * all the C headers included together, each before the headers it relies on. The feature test macros come from the command
+ * line (tests/Makefile), so the system calls of the kernels are declared whatever the include order.
+ */
+#include "rtune_profile.h"
+#include "rtune_node.h"
+#include "rtune_cache.h"
+#include "rtune_async.h"
+#include "rtune_model.h"
+#include "rtune_func_program.h"
+#include "rtune_context.h"
+#include "rtune_sampling.h"
+#include "rtune_region.h"
+#include "rtune_provider.h"
+#include "rtune_api.h"
+#include "rtune_test.h"
+
+int main(void) {
+    RTUNE_CHECK(rtune_monotonic_ns() > 0);
+    RTUNE_CHECK(rtune_node_owns(3, 1, 2));
+    RTUNE_CHECK(rtune_hash64_str(RTUNE_FNV_OFFSET, "a") != rtune_hash64_str(RTUNE_FNV_OFFSET, "b"));
+    RTUNE_CHECK(rtune_data_type_size(RTUNE_double) == sizeof(double));
+    return 0;
+}
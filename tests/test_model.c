@@ -0,0 +1,148 @@
+/**
+ * tests of the recursive least squares models: convergence of theta on linear and quadratic funcs, tracking of a func that
+ * changes with a forgetting factor, the optimum of a convex quadratic, and the best corner of a linear model.
+ */
+#include "rtune_model.h"
+#include "rtune_test.h"
+
+#define MAX_N 3
+#define MAX_P (1 + MAX_N + MAX_N * (MAX_N + 1) / 2)
+
+typedef struct model_storage {
+    double theta[MAX_P], P[MAX_P * MAX_P], phi[MAX_P], Pphi[MAX_P], work[MAX_N * (MAX_N + 1)], center[MAX_N], half_range[MAX_N];
+} model_storage_t;
+
+static void model_init(rtune_model_rls_t *m, model_storage_t *s, rtune_kind_t kind, int n, const double *lo, const double *hi,
+                       double forgetting) {
+    m->theta = s->theta;
+    m->P = s->P;
+    m->phi = s->phi;
+    m->Pphi = s->Pphi;
+    m->work = s->work;
+    m->center = s->center;
+    m->half_range = s->half_range;
+    RTUNE_CHECK(rtune_model_init(m, kind, n, lo, hi, forgetting, 0.0) == 0);
+}
+
+static int near(double a, double b, double tol) {
+    return fabs(a - b) <= tol;
+}
+
+//y = 3 + 2*x0 - x1 over [0, 10] x [0, 4]
+static double linear(const double *x) {
+    return 3.0 + 2.0 * x[0] - x[1];
+}
+
+static void test_linear(void) {
+    const double lo[] = {0.0, 0.0}, hi[] = {10.0, 4.0};
+    rtune_model_rls_t m;
+    model_storage_t s;
+    model_init(&m, &s, RTUNE_MODEL_LINEAR, 2, lo, hi, RTUNE_MODEL_DEFAULT_FORGETTING);
+    RTUNE_CHECK(m.p == 3);
+    double x[2], value, stddev;
+    for (int i = 0; i <= 10; i++) {
+        for (int j = 0; j <= 4; j++) {
+            x[0] = i;
+            x[1] = j;
+            RTUNE_CHECK(rtune_model_predict(&m, x, &value, &stddev) == (m.num_samples < m.p ? -1 : 0));
+            rtune_model_update(&m, x, linear(x));
+        }
+    }
+    //theta is over the normalized values: the value at the center, then the slopes times the half ranges
+    RTUNE_CHECK(near(m.theta[0], 11.0, 1e-4) && near(m.theta[1], 10.0, 1e-4) && near(m.theta[2], -2.0, 1e-4));
+    x[0] = 7.5;
+    x[1] = 0.5;
+    RTUNE_CHECK(rtune_model_predict(&m, x, &value, &stddev) == 0 && near(value, linear(x), 1e-4) && stddev < 1e-3);
+
+    //predictions only read the model
+    for (int i = 0; i < m.p; i++) s.phi[i] = -1.0;
+    RTUNE_CHECK(rtune_model_predict(&m, x, &value, &stddev) == 0);
+    for (int i = 0; i < m.p; i++) RTUNE_CHECK(s.phi[i] == -1.0);
+}
+
+//y = (x0 - 3)^2 + 2*(x1 - 1)^2 + 0.5*(x0 - 3)*(x1 - 1) + 5 over [0, 10] x [-2, 2], minimum 5 at (3, 1)
+static double quadratic(const double *x) {
+    double a = x[0] - 3.0, b = x[1] - 1.0;
+    return a * a + 2.0 * b * b + 0.5 * a * b + 5.0;
+}
+
+static void test_quadratic(void) {
+    const double lo[] = {0.0, -2.0}, hi[] = {10.0, 2.0};
+    rtune_model_rls_t m;
+    model_storage_t s;
+    model_init(&m, &s, RTUNE_MODEL_QUADRATIC, 2, lo, hi, RTUNE_MODEL_DEFAULT_FORGETTING);
+    RTUNE_CHECK(m.p == 6);
+    double x[2], value, stddev;
+    for (int i = 0; i <= 10; i++) {
+        for (int j = -2; j <= 2; j++) {
+            x[0] = i;
+            x[1] = j;
+            rtune_model_update(&m, x, quadratic(x));
+        }
+    }
+    //at the center (5, 0): 4 + 2 + 0.5*2*(-1) + 5 = 10
+    RTUNE_CHECK(near(m.theta[0], 10.0, 1e-3));
+    x[0] = 8.25;
+    x[1] = -1.5;
+    RTUNE_CHECK(rtune_model_predict(&m, x, &value, &stddev) == 0 && near(value, quadratic(x), 1e-3));
+    RTUNE_CHECK(rtune_model_optimum(&m, 0, x) == 0 && near(x[0], 3.0, 1e-3) && near(x[1], 1.0, 1e-3));
+    //-y is not concave to maximize
+    RTUNE_CHECK(rtune_model_optimum(&m, 1, x) == 0);
+    RTUNE_CHECK((x[0] == 0.0 || x[0] == 10.0) && (x[1] == -2.0 || x[1] == 2.0));
+}
+
+//error of the prediction at x = 1 after the func changes from 1 + x to 5 - x over [0, 2]
+static double tracking_error(double forgetting) {
+    const double lo[] = {0.0}, hi[] = {2.0};
+    rtune_model_rls_t m;
+    model_storage_t s;
+    model_init(&m, &s, RTUNE_MODEL_LINEAR, 1, lo, hi, forgetting);
+    double x, value, stddev;
+    for (int i = 0; i < 200; i++) {
+        x = (i % 21) * 0.1;
+        rtune_model_update(&m, &x, 1.0 + x);
+    }
+    for (int i = 0; i < 200; i++) {
+        x = (i % 21) * 0.1;
+        rtune_model_update(&m, &x, 5.0 - x);
+    }
+    x = 1.5;
+    RTUNE_CHECK(rtune_model_predict(&m, &x, &value, &stddev) == 0);
+    return fabs(value - (5.0 - x));
+}
+
+static void test_forgetting(void) {
+    //the old samples are forgotten with lambda < 1, and weigh as much as the new ones without forgetting
+    RTUNE_CHECK(tracking_error(0.9) < 1e-3);
+    RTUNE_CHECK(tracking_error(1.0) > 0.5);
+}
+
+//y = x0 - 2*x1 + 0.5*x2 over [0, 1]^3
+static void test_best_corner(void) {
+    const double lo[] = {0.0, 0.0, 0.0}, hi[] = {1.0, 1.0, 1.0};
+    rtune_model_rls_t m;
+    model_storage_t s;
+    model_init(&m, &s, RTUNE_MODEL_LINEAR, 3, lo, hi, RTUNE_MODEL_DEFAULT_FORGETTING);
+    double x[3];
+    for (int i = 0; i < 27; i++) {
+        x[0] = (i % 3) * 0.5;
+        x[1] = (i / 3 % 3) * 0.5;
+        x[2] = (i / 9) * 0.5;
+        rtune_model_update(&m, x, x[0] - 2.0 * x[1] + 0.5 * x[2]);
+    }
+    double z[3];
+    rtune_model_best_corner(&m, 0, z);
+    RTUNE_CHECK(z[0] == -1.0 && z[1] == 1.0 && z[2] == -1.0);
+    rtune_model_best_corner(&m, 1, z);
+    RTUNE_CHECK(z[0] == 1.0 && z[1] == -1.0 && z[2] == 1.0);
+    //the optimum of a linear model is its best corner
+    RTUNE_CHECK(rtune_model_optimum(&m, 0, x) == 0 && x[0] == 0.0 && x[1] == 1.0 && x[2] == 0.0);
+}
+
+int main(void) {
+    test_linear();
+    test_quadratic();
+    test_forgetting();
+    test_best_corner();
+    return 0;
+}
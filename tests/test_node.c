@@ -0,0 +1,90 @@
+/**
+ * multi-process test of the node-local coordination: forked ranks attach the segment of a region over one left by a
+ * crashed job, sample their share of the configurations, agree on the same winner, and agree again on a new winner after
+ * a new round is started.
+ */
+#include "rtune_node.h"
+#include <sys/wait.h>
+#include "rtune_test.h"
+
+#define NUM_RANKS 4
+#define NUM_CONFIGS 10
+
+static char prefix[64];
+
+//value of a configuration in a round, the best (min) one is 7 in round 0 and 2 in round 1
+static double value_of(int round, int config) {
+    int best = round == 0 ? 7 : 2;
+    return 1.0 + (config - best) * (config - best) + 0.01 * round;
+}
+
+static int run_rank(int rank) {
+    rtune_node_shared_t *shared = rtune_node_attach(prefix, 3, rank, NUM_RANKS, NUM_CONFIGS);
+    if (!shared) return 10;
+    for (int round = 0; round < 2; round++) {
+        if (round > 0) rtune_node_round_begin(shared, rank);
+        for (int i = 0;; i++) {
+            int c = rtune_node_config_of(shared, rank, i);
+            if (c < 0) break;
+            if (!rtune_node_owns(c, rank, NUM_RANKS)) return 11;
+            for (int s = 0; s < 3; s++) rtune_node_stat_add(shared, c, value_of(round, c));
+        }
+        int winner = rtune_node_agree(shared, rank, 0);
+        if (winner != (round == 0 ? 7 : 2)) return 12 + round;
+    }
+    if (__atomic_load_n(&shared->round, __ATOMIC_ACQUIRE) != 2) return 14;
+    rtune_node_detach(shared, prefix, 3);
+    return 0;
+}
+
+//leave a segment as a crashed job does: another shape, set up, with a stale barrier count, and a creator that is gone
+static void make_stale_segment(void) {
+    pid_t dead = fork();
+    RTUNE_CHECK(dead >= 0);
+    if (dead == 0) _exit(0);
+    waitpid(dead, NULL, 0);
+    char name[256];
+    rtune_node_shm_name(name, sizeof(name), prefix, 3);
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    RTUNE_CHECK(fd >= 0);
+    size_t size = rtune_node_shared_size(NUM_CONFIGS);
+    RTUNE_CHECK(ftruncate(fd, (off_t) size) == 0);
+    rtune_node_shared_t *stale = (rtune_node_shared_t *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    RTUNE_CHECK(stale != MAP_FAILED);
+    stale->magic = RTUNE_NODE_MAGIC;
+    stale->num_ranks = NUM_RANKS;
+    stale->num_configs = NUM_CONFIGS;
+    stale->attached = 3;
+    stale->creator_pid = (int32_t) dead;
+    stale->barrier.count = 3;
+    for (int c = 0; c < NUM_CONFIGS; c++) {
+        rtune_node_stats(stale)[c].sum = -100.0;
+        rtune_node_stats(stale)[c].count = 1;
+    }
+    munmap(stale, size);
+}
+
+int main(void) {
+    snprintf(prefix, sizeof(prefix), "rtune_test_node.%d", (int) getpid());
+    make_stale_segment();
+    pid_t pids[NUM_RANKS];
+    //the other ranks start first, and must not attach the stale segment
+    for (int rank = NUM_RANKS - 1; rank >= 0; rank--) {
+        pids[rank] = fork();
+        RTUNE_CHECK(pids[rank] >= 0);
+        if (pids[rank] == 0) _exit(run_rank(rank));
+        if (rank == NUM_RANKS - 1) usleep(20000);
+    }
+    for (int rank = 0; rank < NUM_RANKS; rank++) {
+        int status;
+        RTUNE_CHECK(waitpid(pids[rank], &status, 0) == pids[rank]);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) fprintf(stderr, "rank %d: status %d\n", rank, status);
+        RTUNE_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    //the last rank to detach removed the segment
+    char name[256];
+    rtune_node_shm_name(name, sizeof(name), prefix, 3);
+    RTUNE_CHECK(shm_open(name, O_RDWR, 0600) < 0);
+    return 0;
+}
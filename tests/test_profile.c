@@ -0,0 +1,44 @@
+/**
+ * tests of the self-profiling kernels and of the RTUNE_PROFILE_START/RTUNE_PROFILE_STOP probes.
+ */
+#define RTUNE_PROFILE 1
+#include "rtune_profile.h"
+#include "rtune_test.h"
+
+static void test_probe(void) {
+    rtune_tsc_timer_t timer;
+    rtune_tsc_timer_init(&timer, 1000000);
+    rtune_profile_t profile;
+    memset(&profile, 0, sizeof(profile));
+
+    rtune_profile_t *p = &profile;
+    RTUNE_PROFILE_START(&timer, p, t0);
+    RTUNE_PROFILE_STOP(&timer, p, RTUNE_PROFILE_APPLIER, t0);
+    RTUNE_CHECK(profile.hist[RTUNE_PROFILE_APPLIER].count == 1);
+
+    //profiling enabled between start and stop: the probe is not recorded as a latency since time 0
+    rtune_profile_t *off = NULL;
+    RTUNE_PROFILE_START(&timer, off, t1);
+    off = &profile;
+    RTUNE_PROFILE_STOP(&timer, off, RTUNE_PROFILE_APPLIER, t1);
+    RTUNE_CHECK(profile.hist[RTUNE_PROFILE_APPLIER].count == 1);
+    RTUNE_CHECK(profile.hist[RTUNE_PROFILE_APPLIER].max_ns < 1000000000ull);
+}
+
+static void test_hist(void) {
+    rtune_profile_hist_t h, m;
+    memset(&h, 0, sizeof(h));
+    memset(&m, 0, sizeof(m));
+    for (uint64_t ns = 1; ns <= 1000; ns++) rtune_profile_record(&h, ns);
+    RTUNE_CHECK(h.count == 1000 && h.min_ns == 1 && h.max_ns == 1000);
+    RTUNE_CHECK(rtune_profile_quantile(&h, 0.5) == 511);
+    rtune_profile_merge(&m, &h);
+    rtune_profile_merge(&m, &h);
+    RTUNE_CHECK(m.count == 2000 && m.sum_ns == 2 * h.sum_ns && m.min_ns == 1);
+}
+
+int main(void) {
+    test_probe();
+    test_hist();
+    return 0;
+}
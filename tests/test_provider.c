@@ -0,0 +1,99 @@
+/**
+ * tests of the built-in providers: the sysfs counter parser, and the energy reader over a fake powercap tree, read
+ * concurrently by several threads.
+ */
+#include "rtune_provider.h"
+#include <math.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "rtune_test.h"
+
+static char root[] = "/tmp/rtune_test_provider.XXXXXX";
+
+static void write_file(const char *name, const char *content) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE *f = fopen(path, "w");
+    RTUNE_CHECK(f != NULL);
+    fputs(content, f);
+    fclose(f);
+}
+
+static int read_file(const char *name, uint64_t *value) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    int fd = open(path, O_RDONLY);
+    RTUNE_CHECK(fd >= 0);
+    int err = rtune_sysfs_pread_u64(fd, value);
+    close(fd);
+    return err;
+}
+
+static void test_sysfs_parse(void) {
+    uint64_t v = 0;
+    write_file("num", "262143328850\n");
+    RTUNE_CHECK(read_file("num", &v) == 0 && v == 262143328850ull);
+    write_file("num", "42");
+    RTUNE_CHECK(read_file("num", &v) == 0 && v == 42);
+    write_file("num", "12abc\n");
+    RTUNE_CHECK(read_file("num", &v) == -1);
+    write_file("num", "-5\n");
+    RTUNE_CHECK(read_file("num", &v) == -1);
+    write_file("num", " 7\n");
+    RTUNE_CHECK(read_file("num", &v) == -1);
+    write_file("num", "");
+    RTUNE_CHECK(read_file("num", &v) == -1);
+    RTUNE_CHECK(v == 42);
+}
+
+static rtune_energy_reader_t reader;
+
+static void *reader_thread(void *arg) {
+    (void) arg;
+    for (int i = 0; i < 2000; i++) rtune_energy_read(&reader);
+    return NULL;
+}
+
+static void test_energy(void) {
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s/intel-rapl:0", root);
+    RTUNE_CHECK(mkdir(dir, 0755) == 0);
+    write_file("intel-rapl:0/max_energy_range_uj", "1000000\n");
+    write_file("intel-rapl:0/energy_uj", "999000\n");
+    RTUNE_CHECK(rtune_energy_reader_init(&reader, root) == 1);
+    RTUNE_CHECK(rtune_energy_read(&reader) == 0.0);
+
+    //wraparound: 999000 -> 1000000 -> 500
+    write_file("intel-rapl:0/energy_uj", "500\n");
+    RTUNE_CHECK(fabs(rtune_energy_read(&reader) - 1500e-6) < 1e-12);
+
+    //concurrent readers of an unchanged counter add nothing, then every reader sees the same total
+    pthread_t threads[4];
+    write_file("intel-rapl:0/energy_uj", "2500\n");
+    for (int t = 0; t < 4; t++) RTUNE_CHECK(pthread_create(&threads[t], NULL, reader_thread, NULL) == 0);
+    for (int t = 0; t < 4; t++) pthread_join(threads[t], NULL);
+    RTUNE_CHECK(fabs(rtune_energy_read(&reader) - 3500e-6) < 1e-12);
+
+    //a reading older than the last one is dropped rather than taken as a wraparound
+    write_file("intel-rapl:0/energy_uj", "2000\n");
+    RTUNE_CHECK(fabs(rtune_energy_read(&reader) - 3500e-6) < 1e-12);
+    rtune_energy_reader_fini(&reader);
+
+    snprintf(dir, sizeof(dir), "%s/intel-rapl:0/energy_uj", root);
+    unlink(dir);
+    snprintf(dir, sizeof(dir), "%s/intel-rapl:0/max_energy_range_uj", root);
+    unlink(dir);
+    snprintf(dir, sizeof(dir), "%s/intel-rapl:0", root);
+    rmdir(dir);
+}
+
+int main(void) {
+    RTUNE_CHECK(mkdtemp(root) != NULL);
+    test_sysfs_parse();
+    test_energy();
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/num", root);
+    unlink(path);
+    rmdir(root);
+    return 0;
+}
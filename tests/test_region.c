@@ -0,0 +1,195 @@
+/**
+ * arena allocation and growth of the pointer arrays, the codeptr_ra index of the regions, and the per-thread sample
+ * buffers of a concurrent region recorded by several threads and merged into the state rings.
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include "rtune_region.h"
+#include "rtune_test.h"
+
+static void test_arena(void) {
+    rtune_region_t *region = rtune_region_alloc();
+    RTUNE_CHECK(region);
+    rtune_arena_t *a = &region->arena;
+
+    //small allocations are aligned, zeroed and do not overlap
+    char *p[100];
+    for (int i = 0; i < 100; i++) {
+        p[i] = (char *) rtune_arena_alloc(a, 1 + i);
+        RTUNE_CHECK(p[i] && ((uintptr_t) p[i] % RTUNE_ARENA_ALIGN) == 0);
+        for (int k = 0; k <= i; k++) RTUNE_CHECK(p[i][k] == 0);
+        memset(p[i], i, 1 + i);
+    }
+    for (int i = 0; i < 100; i++) {
+        for (int k = 0; k <= i; k++) RTUNE_CHECK(p[i][k] == (char) i);
+    }
+
+    //a large allocation gets its own block, and the current block keeps being used
+    rtune_arena_block_t *head = a->head;
+    char *big = (char *) rtune_arena_alloc(a, 3 * RTUNE_ARENA_BLOCK_SIZE);
+    RTUNE_CHECK(big && a->head == head);
+    char *small = (char *) rtune_arena_alloc(a, 8);
+    RTUNE_CHECK(small && a->head == head);
+
+    //the pointer arrays double, old elements are kept and pointers to the elements stay valid
+    rtune_var_t **vars = NULL;
+    int capacity = 0;
+    rtune_var_t *v[100];
+    for (int i = 0; i < 100; i++) {
+        RTUNE_CHECK(rtune_arena_reserve(a, (void **) &vars, &capacity, i + 1, sizeof(rtune_var_t *), RTUNE_INIT_NUM_VARS) == 0);
+        v[i] = (rtune_var_t *) rtune_arena_alloc(a, sizeof(rtune_var_t));
+        vars[i] = v[i];
+    }
+    RTUNE_CHECK(capacity == 128);
+    for (int i = 0; i < 100; i++) RTUNE_CHECK(vars[i] == v[i]);
+    rtune_region_free(region);
+}
+
+static void test_index(void) {
+    rtune_region_index_t idx;
+    memset(&idx, 0, sizeof(idx));
+    static char code[1000];
+    static rtune_region_t regions[1000];
+    RTUNE_CHECK(rtune_region_index_lookup(&idx, &code[0]) == NULL);
+    for (int i = 0; i < 1000; i++) RTUNE_CHECK(rtune_region_index_insert(&idx, &code[i], &regions[i]) == 0);
+    RTUNE_CHECK(idx.num_regions == 1000 && 2 * idx.num_regions <= idx.capacity);
+    for (int i = 0; i < 1000; i++) RTUNE_CHECK(rtune_region_index_lookup(&idx, &code[i]) == &regions[i]);
+    RTUNE_CHECK(rtune_region_index_lookup(&idx, &regions[0]) == NULL);
+    RTUNE_CHECK(rtune_region_index_insert(&idx, &code[5], &regions[6]) == 0);
+    RTUNE_CHECK(idx.num_regions == 1000 && rtune_region_index_lookup(&idx, &code[5]) == &regions[6]);
+    rtune_region_index_free(&idx);
+}
+
+enum { TLS_THREADS = 4, TLS_ROUNDS = 5, TLS_PER_ROUND = 50, TLS_BUFFER = 64 };
+
+static rtune_var_t *tls_add_var(rtune_region_t *region, rtune_data_type_t type, int ring_capacity) {
+    rtune_var_t *v = (rtune_var_t *) rtune_arena_alloc(&region->arena, sizeof(rtune_var_t));
+    v->stvar.type = type;
+    v->stvar.states.values = rtune_arena_alloc(&region->arena, rtune_data_type_size(type) * (size_t) ring_capacity);
+    v->stvar.states.capacity = (unsigned int) ring_capacity;
+    v->stvar.states.mask = (unsigned int) ring_capacity - 1;
+    return v;
+}
+
+static rtune_region_t *tls_region(int ring_capacity) {
+    rtune_region_t *region = rtune_region_alloc();
+    RTUNE_CHECK(region != NULL);
+    region->vars = (rtune_var_t **) rtune_arena_alloc(&region->arena, 2 * sizeof(rtune_var_t *));
+    region->vars[0] = tls_add_var(region, RTUNE_int, ring_capacity);
+    region->vars[1] = tls_add_var(region, RTUNE_double, ring_capacity);
+    region->num_vars = 2;
+    region->funcs = (rtune_func_t **) rtune_arena_alloc(&region->arena, sizeof(rtune_func_t *));
+    region->funcs[0] = (rtune_func_t *) rtune_arena_alloc(&region->arena, sizeof(rtune_func_t));
+    region->funcs[0]->stvar.type = RTUNE_short;
+    region->num_funcs = 1;
+    return region;
+}
+
+static void test_tls_layout(void) {
+    rtune_region_t *region = tls_region(16);
+    RTUNE_CHECK(rtune_region_tls_alloc(region, MAX_NUM_THREADS + 10, TLS_BUFFER) == 0);
+    RTUNE_CHECK(region->max_num_threads == MAX_NUM_THREADS);
+    RTUNE_CHECK(rtune_region_tls_of(region, MAX_NUM_THREADS) == NULL && rtune_region_tls_of(region, -1) == NULL);
+    //the cache lines written by a thread: its vars/funcs and sample buffers, which no other thread writes to
+    uintptr_t first[MAX_NUM_THREADS], last[MAX_NUM_THREADS];
+    for (int t = 0; t < MAX_NUM_THREADS; t++) {
+        rtune_region_tls_t *tls = rtune_region_tls_of(region, t);
+        RTUNE_CHECK(tls != NULL && (uintptr_t) tls % RTUNE_CACHE_LINE_SIZE == 0);
+        RTUNE_CHECK((uintptr_t) tls->vars % RTUNE_CACHE_LINE_SIZE == 0 && tls->funcs == tls->vars + 2 && tls->states_capacity == TLS_BUFFER);
+        first[t] = (uintptr_t) tls->vars / RTUNE_CACHE_LINE_SIZE;
+        last[t] = ((uintptr_t) tls->funcs[0].states + TLS_BUFFER * sizeof(short) - 1) / RTUNE_CACHE_LINE_SIZE;
+        for (int i = 0; i < 3; i++) {
+            uintptr_t p = (uintptr_t) tls->vars[i].states;
+            RTUNE_CHECK(p && p / RTUNE_CACHE_LINE_SIZE >= first[t] && p / RTUNE_CACHE_LINE_SIZE <= last[t]);
+        }
+    }
+    for (int t = 0; t < MAX_NUM_THREADS; t++) {
+        for (int u = 0; u < MAX_NUM_THREADS; u++) RTUNE_CHECK(u == t || last[t] < first[u] || last[u] < first[t]);
+    }
+    rtune_region_free(region);
+}
+
+typedef struct tls_worker {
+    rtune_region_t *region;
+    int thread;
+    int round;
+} tls_worker_t;
+
+static void *tls_record(void *arg) {
+    tls_worker_t *w = (tls_worker_t *) arg;
+    rtune_region_tls_t *tls = rtune_region_tls_of(w->region, w->thread);
+    for (int k = 0; k < TLS_PER_ROUND; k++) {
+        utype_t v, one;
+        v._int_value = w->thread * 100000 + w->round * TLS_PER_ROUND + k;
+        one._double_value = 1.0;
+        rtune_region_tls_record(tls, &tls->vars[0], &w->region->vars[0]->stvar, v);
+        rtune_region_tls_record(tls, &tls->vars[1], &w->region->vars[1]->stvar, one);
+        rtune_utype_add(RTUNE_double, &tls->vars[1].accu4End_or_accu4Diff, one);
+        tls->batch_count++;
+    }
+    return NULL;
+}
+
+//rounds of samples recorded by several threads at the same time, each round merged after the threads are joined
+static void test_tls_threads(void) {
+    rtune_region_t *region = tls_region(1024);
+    RTUNE_CHECK(rtune_region_tls_alloc(region, TLS_THREADS, TLS_BUFFER) == 0);
+    for (int r = 0; r < TLS_ROUNDS; r++) {
+        pthread_t threads[TLS_THREADS];
+        tls_worker_t workers[TLS_THREADS];
+        for (int t = 0; t < TLS_THREADS; t++) {
+            workers[t].region = region;
+            workers[t].thread = t;
+            workers[t].round = r;
+            RTUNE_CHECK(pthread_create(&threads[t], NULL, tls_record, &workers[t]) == 0);
+        }
+        for (int t = 0; t < TLS_THREADS; t++) pthread_join(threads[t], NULL);
+        rtune_region_tls_merge(region);
+        RTUNE_CHECK(region->tls[0].batch_count == 0 && region->tls[0].vars[0].num_states == 0);
+    }
+    const stvar_t *ints = &region->vars[0]->stvar, *ones = &region->vars[1]->stvar;
+    RTUNE_CHECK(ints->states.head == TLS_THREADS * TLS_ROUNDS * TLS_PER_ROUND && ints->num_states == (int) ints->states.head);
+    RTUNE_CHECK(ones->accu4End_or_accu4Diff._double_value == TLS_THREADS * TLS_ROUNDS * TLS_PER_ROUND);
+    //every sample is merged once, and the samples of a thread keep their order
+    int next[TLS_THREADS] = {0};
+    const int *values = (const int *) ints->states.values;
+    for (unsigned long i = 0; i < ints->states.head; i++) {
+        int t = values[i] / 100000;
+        RTUNE_CHECK(t >= 0 && t < TLS_THREADS && values[i] % 100000 == next[t]);
+        next[t]++;
+    }
+    for (int t = 0; t < TLS_THREADS; t++) RTUNE_CHECK(next[t] == TLS_ROUNDS * TLS_PER_ROUND);
+    rtune_region_free(region);
+}
+
+//a buffer that wraps keeps its most recent samples, merged oldest first into a ring that wraps as well
+static void test_tls_wrap(void) {
+    rtune_region_t *region = tls_region(128);
+    RTUNE_CHECK(rtune_region_tls_alloc(region, 1, TLS_BUFFER) == 0);
+    rtune_region_tls_t *tls = rtune_region_tls_of(region, 0);
+    stvar_t *ints = &region->vars[0]->stvar;
+    for (int r = 0; r < 3; r++) {
+        for (int k = 0; k < TLS_BUFFER + 10; k++) {
+            utype_t v;
+            v._int_value = r * 1000 + k;
+            rtune_region_tls_record(tls, &tls->vars[0], ints, v);
+        }
+        rtune_region_tls_merge(region);
+    }
+    RTUNE_CHECK(ints->states.head == 3 * TLS_BUFFER && ints->num_states == 128);
+    const int *values = (const int *) ints->states.values;
+    for (int i = 0; i < 128; i++) { //the last 128 samples, i.e. the 64 kept of round 1 and of round 2
+        unsigned long pos = ints->states.head - 128 + i;
+        RTUNE_CHECK(values[pos & ints->states.mask] == (i < 64 ? 1000 : 2000) + 10 + i % 64);
+    }
+    rtune_region_free(region);
+}
+
+int main(void) {
+    test_arena();
+    test_index();
+    test_tls_layout();
+    test_tls_threads();
+    test_tls_wrap();
+    return 0;
+}
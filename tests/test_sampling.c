@@ -0,0 +1,89 @@
+/**
+ * tests of the adaptive sampling decisions: separation of a candidate from the best with an absolute tolerance, termination
+ * when outliers are rejected, re-centring after a shift of the level, and the racing of candidates.
+ */
+#include "rtune_sampling.h"
+#include "rtune_test.h"
+
+//deterministic noise in [-1, 1)
+static double noise(unsigned *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return (double) ((*seed >> 8) & 0xffff) / 32768.0 - 1.0;
+}
+
+static void fill(rtune_sample_stats_t *s, double mean, double spread, int n, unsigned seed) {
+    rtune_sample_stats_reset(s);
+    for (int i = 0; i < n; i++) rtune_sample_stats_add(s, mean + spread * noise(&seed), 0.0);
+}
+
+static void test_decide(void) {
+    const double z = RTUNE_SAMPLING_DEFAULT_CONFIDENCE, tol = RTUNE_SAMPLING_DEFAULT_TOLERANCE;
+    rtune_sample_stats_t best, cand;
+    //times of about a millisecond, 1% apart: the default tolerance does not hide the difference
+    fill(&best, 1.00e-3, 1e-6, 20, 1);
+    fill(&cand, 1.01e-3, 1e-6, 20, 2);
+    RTUNE_CHECK(rtune_sampling_decide(&cand, &best, z, tol, 2, 64) == RTUNE_SAMPLING_WORSE);
+    RTUNE_CHECK(rtune_sampling_decide(&best, &cand, z, tol, 2, 64) == RTUNE_SAMPLING_BETTER);
+    //within an absolute tolerance of 0.02ms, the better candidate is not worth switching to
+    RTUNE_CHECK(rtune_sampling_decide(&best, &cand, z, 2e-5, 2, 64) == RTUNE_SAMPLING_WORSE);
+    RTUNE_CHECK(rtune_sampling_decide(&cand, NULL, z, tol, 2, 64) == RTUNE_SAMPLING_BETTER);
+    RTUNE_CHECK(rtune_sampling_decide(&cand, &best, z, tol, 30, 64) == RTUNE_SAMPLING_CONTINUE);
+
+    //overlapping intervals: continue until max_samples
+    fill(&cand, 1.00e-3, 1e-4, 20, 3);
+    RTUNE_CHECK(rtune_sampling_decide(&cand, &best, z, tol, 2, 64) == RTUNE_SAMPLING_CONTINUE);
+    RTUNE_CHECK(rtune_sampling_decide(&cand, &best, z, tol, 2, 20) == RTUNE_SAMPLING_EXHAUSTED);
+}
+
+static void test_outliers(void) {
+    rtune_sample_stats_t best, cand;
+    fill(&best, 1.0, 0.01, 20, 4);
+    //every other sample is far off: the rejected ones count toward max_samples, so the candidate is decided
+    rtune_sample_stats_reset(&cand);
+    unsigned seed = 5;
+    rtune_sampling_decision_t d = RTUNE_SAMPLING_CONTINUE;
+    int taken = 0;
+    for (; taken < 1000 && d == RTUNE_SAMPLING_CONTINUE; taken++) {
+        double x = taken >= 16 && taken % 2 ? 50.0 : 1.0 + 0.2 * noise(&seed);
+        rtune_sample_stats_add(&cand, x, RTUNE_SAMPLING_DEFAULT_OUTLIER_MADS);
+        d = rtune_sampling_decide(&cand, &best, RTUNE_SAMPLING_DEFAULT_CONFIDENCE, 0.0, 2, 64);
+    }
+    RTUNE_CHECK(d != RTUNE_SAMPLING_CONTINUE && taken <= 64);
+    RTUNE_CHECK(cand.num_rejected > 0 && rtune_sample_stats_taken(&cand) == taken);
+
+    //the level shifts from 1 to 5: after RTUNE_SAMPLING_MAX_CONSECUTIVE_REJECTS rejections the window and the mean follow it
+    rtune_sample_stats_reset(&cand);
+    seed = 6;
+    for (int i = 0; i < RTUNE_SAMPLING_ROBUST_WINDOW; i++) RTUNE_CHECK(rtune_sample_stats_add(&cand, 1.0 + 0.01 * noise(&seed), 3.0) == 0);
+    int rejected = 0;
+    for (int i = 0; i < 4 * RTUNE_SAMPLING_ROBUST_WINDOW; i++) rejected += rtune_sample_stats_add(&cand, 5.0 + 0.01 * noise(&seed), 3.0) != 0;
+    RTUNE_CHECK(rejected == RTUNE_SAMPLING_MAX_CONSECUTIVE_REJECTS && cand.window_count == 4 * RTUNE_SAMPLING_ROBUST_WINDOW - rejected);
+    double window_mean = 0.0;
+    for (int i = 0; i < RTUNE_SAMPLING_ROBUST_WINDOW; i++) window_mean += cand.window[i] / RTUNE_SAMPLING_ROBUST_WINDOW;
+    RTUNE_CHECK(window_mean > 4.9);
+    RTUNE_CHECK(cand.count == cand.window_count && fabs(cand.mean - 5.0) < 0.01 && rtune_sample_stats_variance(&cand) < 1e-3);
+    RTUNE_CHECK(rtune_sample_stats_taken(&cand) == 5 * RTUNE_SAMPLING_ROBUST_WINDOW);
+}
+
+static void test_race(void) {
+    enum { N = 5 };
+    const double means[N] = {1.3, 1.1, 1.0, 1.2, 1.05};
+    rtune_sample_stats_t stats[N];
+    for (int c = 0; c < N; c++) rtune_sample_stats_reset(&stats[c]);
+    unsigned seed = 7;
+    int c, steps = 0;
+    while ((c = rtune_sampling_race_next(stats, N, 200)) >= 0) {
+        rtune_sample_stats_add(&stats[c], means[c] + 0.05 * noise(&seed), RTUNE_SAMPLING_DEFAULT_OUTLIER_MADS);
+        rtune_sampling_race_eliminate(stats, N, RTUNE_SAMPLING_DEFAULT_CONFIDENCE, 0.0, 4, 0);
+        steps++;
+    }
+    RTUNE_CHECK(rtune_sampling_race_leader(stats, N, 0) == 2);
+    RTUNE_CHECK(stats[0].eliminated && steps < N * 200);
+}
+
+int main(void) {
+    test_decide();
+    test_outliers();
+    test_race();
+    return 0;
+}
@@ -0,0 +1,148 @@
+/**
+ * tests of the search kernels of rtune_search.hpp, driven by synthetic objective functions over the value indices.
+ */
+#include <cmath>
+#include <vector>
+#include "rtune_test.h"
+#include "rtune_search.hpp"
+#include "rtune_replay.hpp"
+
+using namespace rtune::search;
+
+struct simplex_fixture {
+    std::vector<int> num_values, vertices, trial, reflect;
+    std::vector<double> values;
+    rtune_search_simplex_t s;
+
+    explicit simplex_fixture(const std::vector<int> &nv) : num_values(nv), vertices((nv.size() + 1) * nv.size()),
+        trial(nv.size()), reflect(nv.size()), values(nv.size() + 1), s() {
+        s.n = (int) nv.size();
+        s.num_values = num_values.data();
+        s.vertices = vertices.data();
+        s.values = values.data();
+        s.trial = trial.data();
+        s.reflect = reflect.data();
+    }
+
+    template <typename F>
+    void run(F f) {
+        std::vector<int> point(num_values.size());
+        while (simplex_next(&s, point.data())) simplex_report(&s, f(point.data()));
+    }
+};
+
+//the tolerance is absolute, and the initial simplex alone never converges
+static void test_simplex_tolerance() {
+    simplex_fixture fx({64});
+    int start = 0;
+    simplex_begin(&fx.s, &start, 100.0, 100);
+    fx.run([](const int *x) { return std::fabs(x[0] - 40.0); });
+    RTUNE_CHECK(fx.s.converged && fx.s.num_steps >= 1 && fx.s.num_evaluations > 2);
+
+    //a relative tolerance of 0.1 would stop at the first spread below 10% of 1000
+    simplex_fixture fx2({64});
+    simplex_begin(&fx2.s, &start, 0.5, 200);
+    fx2.run([](const int *x) { return 1000.0 + std::fabs(x[0] - 40.0); });
+    RTUNE_CHECK(fx2.s.converged && std::abs(simplex_vertex(&fx2.s, 0)[0] - 40) <= 1);
+}
+
+struct bandit_fixture {
+    std::vector<int> num_values, arms, alive;
+    std::vector<double> sum;
+    std::vector<long> count;
+    rtune_search_bandit_t s;
+
+    explicit bandit_fixture(const std::vector<int> &nv) : num_values(nv), arms(RTUNE_SEARCH_MAX_ARMS * nv.size()),
+        alive(RTUNE_SEARCH_MAX_ARMS), sum(RTUNE_SEARCH_MAX_ARMS), count(RTUNE_SEARCH_MAX_ARMS), s() {
+        s.n = (int) nv.size();
+        s.num_values = num_values.data();
+        s.max_arms = RTUNE_SEARCH_MAX_ARMS;
+        s.arms = arms.data();
+        s.sum = sum.data();
+        s.count = count.data();
+        s.alive = alive.data();
+    }
+
+    template <typename F>
+    void run(F f) {
+        std::vector<int> point(num_values.size());
+        while (bandit_next(&s, point.data())) bandit_report(&s, f(point.data()));
+    }
+};
+
+static double bowl(const int *x) { return std::fabs(x[0] - 5.0) + std::fabs(x[1] - 2.0); }
+
+//a space that fits in the arms is searched whole, within one exhaustive pass with the default budget, and resampled with
+//an explicit one
+static void test_bandit_small_space() {
+    for (int ucb = 0; ucb <= 1; ucb++) {
+        for (int budget = 0; budget <= RTUNE_SEARCH_DEFAULT_BUDGET; budget += RTUNE_SEARCH_DEFAULT_BUDGET) {
+            int expected = budget ? budget : 64;
+            bandit_fixture fx({8, 8});
+            bandit_begin(&fx.s, ucb, budget, RTUNE_SEARCH_DEFAULT_EXPLORATION, 1);
+            RTUNE_CHECK(fx.s.num_arms == 64 && fx.s.budget == expected);
+            fx.run(bowl);
+            const int *best = bandit_arm(&fx.s, fx.s.best);
+            RTUNE_CHECK(fx.s.converged && fx.s.num_evaluations == expected && best[0] == 5 && best[1] == 2);
+        }
+    }
+}
+
+//the first UCB pull is chosen as the others, the least used untried arm, not arm 0
+static void test_ucb_first_pull() {
+    bandit_fixture fx({8, 8});
+    std::vector<int> used0(8, 0), used1(8, 0);
+    int *count_value[2] = {used0.data(), used1.data()};
+    fx.s.count_value = count_value;
+    bandit_draw(&fx.s, 64);
+    const int *arm0 = bandit_arm(&fx.s, 0);
+    used0[arm0[0]] = 5;
+    used1[arm0[1]] = 5;
+    bandit_begin(&fx.s, 1, 0, RTUNE_SEARCH_DEFAULT_EXPLORATION, 1);
+    RTUNE_CHECK(fx.s.current != 0 && fx.s.current == bandit_ucb_select(&fx.s));
+    const int *first = bandit_arm(&fx.s, fx.s.current);
+    RTUNE_CHECK(used0[first[0]] == 0 && used1[first[1]] == 0);
+}
+
+//the result of SUCCESSIVE_HALVING stopped early is an arm still alive, even if an eliminated one has a better mean
+static void test_bandit_finish_alive() {
+    bandit_fixture fx({16, 16});
+    bandit_begin(&fx.s, 0, RTUNE_SEARCH_DEFAULT_BUDGET, RTUNE_SEARCH_DEFAULT_EXPLORATION, 1);
+    std::vector<int> point(2);
+    double t = 0.0; //the values drift upward, so the arms sampled in the first round have the lowest means
+    while (fx.s.num_alive == fx.s.num_arms && bandit_next(&fx.s, point.data())) bandit_report(&fx.s, bowl(point.data()) + (t += 1.0));
+    for (int i = 0; i < 3 && bandit_next(&fx.s, point.data()); i++) bandit_report(&fx.s, bowl(point.data()) + (t += 100.0));
+    bandit_finish(&fx.s);
+    bool alive = false;
+    for (int i = 0; i < fx.s.num_alive; i++) alive = alive || fx.s.alive[i] == fx.s.best;
+    RTUNE_CHECK(alive);
+}
+
+//an arity of 0 (strategy_arity of a strategy that is not a gradient one) still narrows the range
+static void test_bracket_arity() {
+    rtune_search_bracket_t b;
+    bracket_begin(&b, strategy_arity(RTUNE_OBJECTIVE_SEARCH_UCB), 0, 31);
+    int i, n = 0;
+    while ((i = bracket_next(&b)) >= 0 && n++ < 64) bracket_report(&b, std::fabs(i - 20.0));
+    RTUNE_CHECK(b.converged && b.best_index == 20 && n < 64);
+}
+
+static void test_replay_unsupported() {
+    rtune::replay::unimodal_surface s({16}, {4}, 0.0);
+    rtune::replay::settings st;
+    st.search_strategy = (rtune_objective_search_strategy_t) 1000;
+    RTUNE_CHECK(!rtune::replay::harness(s, st, 1).run().supported);
+    st.search_strategy = RTUNE_OBJECTIVE_SEARCH_QUATERNARY_GRADIENT;
+    rtune::replay::result r = rtune::replay::harness(s, st, 1).run();
+    RTUNE_CHECK(r.supported && r.config[0] == 4);
+}
+
+int main() {
+    test_simplex_tolerance();
+    test_bandit_small_space();
+    test_ucb_first_pull();
+    test_bandit_finish_alive();
+    test_bracket_arity();
+    test_replay_unsupported();
+    return 0;
+}
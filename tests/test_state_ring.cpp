@@ -0,0 +1,61 @@
+/**
+ * tests of the typed state ring kernels: capacity, push and push_n across the wrap, and the reductions over the most
+ * recent states when the ring has wrapped or is empty.
+ */
+#include <vector>
+#include "rtune_test.h"
+#include "rtune_state_ring.hpp"
+
+using namespace rtune::detail;
+
+static void test_capacity() {
+    RTUNE_CHECK(ring_capacity_for(0) == 1 && ring_capacity_for(1) == 1 && ring_capacity_for(5) == 8 && ring_capacity_for(64) == 64);
+    RTUNE_CHECK(ring_capacity_for((1 << 30) + 1) == RTUNE_STATE_RING_MAX_CAPACITY);
+    RTUNE_CHECK(ring_capacity_for(0x7fffffff) == RTUNE_STATE_RING_MAX_CAPACITY);
+    RTUNE_CHECK(ring_capacity_for(-3) == 1);
+}
+
+static void test_push() {
+    std::vector<int> values(ring_capacity_for(6));
+    rtune_state_ring_t ring;
+    ring_init(&ring, values.data(), 6);
+    RTUNE_CHECK(ring.capacity == 8 && ring.mask == 7 && ring.head == 0 && ring_size(&ring) == 0);
+    RTUNE_CHECK((ring_arg_extreme_recent<int, false>(&ring, 4)) == RTUNE_STATE_RING_NONE);
+    RTUNE_CHECK(ring_sum_recent<int>(&ring, 4) == 0.0);
+
+    for (int i = 0; i < 5; i++) ring_push(&ring, i); //0..4
+    RTUNE_CHECK(ring_size(&ring) == 5 && ring_sum_recent<int>(&ring, 3) == 2 + 3 + 4);
+    RTUNE_CHECK((ring_arg_extreme_recent<int, false>(&ring, 0)) == RTUNE_STATE_RING_NONE);
+
+    //push_n across the end of the array: 5, 6, 7 at the tail and 8, 9 at the start
+    int more[] = {5, 6, 7, 8, 9};
+    ring_push_n(&ring, more, 5);
+    RTUNE_CHECK(ring.head == 10 && ring_size(&ring) == 8 && values[0] == 8 && values[1] == 9 && values[7] == 7);
+    RTUNE_CHECK(ring_sum_recent<int>(&ring, 4) == 6 + 7 + 8 + 9);
+    RTUNE_CHECK(ring_sum_recent<int>(&ring, 100) == 2 + 3 + 4 + 5 + 6 + 7 + 8 + 9);
+
+    //more than the capacity: only the last capacity states are kept
+    std::vector<int> many(20);
+    for (int i = 0; i < 20; i++) many[i] = 100 + i;
+    ring_push_n(&ring, many.data(), 20);
+    RTUNE_CHECK(ring.head == 30 && values[ring_slot_recent(&ring, 0)] == 119 && values[ring_slot_recent(&ring, 7)] == 112);
+}
+
+static void test_arg_extreme_wrap() {
+    std::vector<double> values(4);
+    rtune_state_ring_t ring;
+    ring_init(&ring, values.data(), 4);
+    const double samples[] = {5.0, 1.0, 9.0, 4.0, 3.0, 7.0}; //the ring keeps 9, 4, 3, 7, with 3 and 7 wrapped to the start
+    for (double v : samples) ring_push(&ring, v);
+    RTUNE_CHECK((ring_arg_extreme_recent<double, false>(&ring, 4)) == 1); //3.0
+    RTUNE_CHECK((ring_arg_extreme_recent<double, true>(&ring, 4)) == 3);  //9.0
+    RTUNE_CHECK((ring_arg_extreme_recent<double, true>(&ring, 2)) == 0);  //7.0 among 3, 7
+    RTUNE_CHECK((ring_arg_extreme_recent<double, false>(&ring, 100)) == 1);
+}
+
+int main() {
+    test_capacity();
+    test_push();
+    test_arg_extreme_wrap();
+    return 0;
+}
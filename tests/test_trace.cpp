@@ -0,0 +1,122 @@
+/**
+ * roundtrip of the binary trace files: records appended by a writer (through several doublings of the file) are read back
+ * by the reader, and rtune_trace2csv prints one CSV line per record.
+ */
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "rtune_test.h"
+#include "rtune_trace.hpp"
+
+#define main rtune_trace2csv_main
+#include "../tools/rtune_trace2csv.cpp"
+#undef main
+
+static const uint64_t num_records = 3 * RTUNE_TRACE_INIT_NUM_RECORDS + 5; //grows the file twice
+
+static rtune_trace_record_t make_record(uint64_t i) {
+    rtune_trace_record_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.region_id = 7;
+    rec.iteration = (uint32_t) i;
+    if (i % 3 == 2) {
+        rec.kind = RTUNE_TRACE_RECORD_OBJECTIVE;
+        rec.type = RTUNE_double;
+        rec.state_index = RTUNE_STATUS_SAMPLING;
+        rec.status = RTUNE_STATUS_OBJECTIVE_MET;
+        rec.value._double_value = 0.5 * (double) i;
+    } else {
+        rec.kind = i % 3 == 0 ? RTUNE_TRACE_RECORD_VAR : RTUNE_TRACE_RECORD_FUNC;
+        rec.id = (uint16_t) (i % 5);
+        rec.type = RTUNE_int;
+        rec.state_index = (int32_t) (i % 11);
+        rec.value._int_value = (int) i * 2;
+    }
+    return rec;
+}
+
+//redirect fileno to path, return the saved descriptor to restore
+static int redirect(int fileno, const char *path) {
+    int saved = dup(fileno);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    RTUNE_CHECK(saved >= 0 && fd >= 0);
+    dup2(fd, fileno);
+    close(fd);
+    return saved;
+}
+
+static void restore(int fileno, int saved) {
+    dup2(saved, fileno);
+    close(saved);
+}
+
+//run rtune_trace2csv on path with its stdout redirected to out_path and its stderr to err_path (kept if NULL), return its exit status
+static int run_trace2csv(const char *path, const char *out_path, const char *err_path) {
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = redirect(STDOUT_FILENO, out_path), saved_err = err_path ? redirect(STDERR_FILENO, err_path) : -1;
+    char arg0[] = "rtune_trace2csv";
+    char *argv[] = {arg0, const_cast<char *>(path), NULL};
+    int status = rtune_trace2csv_main(2, argv);
+    fflush(stdout);
+    fflush(stderr);
+    restore(STDOUT_FILENO, saved_out);
+    if (saved_err >= 0) restore(STDERR_FILENO, saved_err);
+    return status;
+}
+
+int main() {
+    char dir[] = "/tmp/rtune_test_trace.XXXXXX";
+    RTUNE_CHECK(mkdtemp(dir) != NULL);
+    std::string prefix = std::string(dir) + "/trace";
+    std::string path = prefix + ".3.rtt", csv_path = std::string(dir) + "/trace.csv";
+
+    rtune_trace_file_t tf;
+    RTUNE_CHECK(rtune::trace::writer_open(&tf, prefix.c_str(), 3) == 0);
+    for (uint64_t i = 0; i < num_records; i++) {
+        rtune_trace_record_t rec = make_record(i);
+        RTUNE_CHECK(rtune::trace::writer_append(&tf, &rec) == 0);
+    }
+    RTUNE_CHECK(tf.capacity == 4 * RTUNE_TRACE_INIT_NUM_RECORDS);
+    rtune::trace::writer_close(&tf);
+
+    {
+        rtune::trace::reader r;
+        RTUNE_CHECK(r.open(path.c_str()) == 0);
+        RTUNE_CHECK(r.header()->thread_id == 3 && r.size() == num_records);
+        for (uint64_t i = 0; i < num_records; i++) {
+            rtune_trace_record_t rec = make_record(i);
+            RTUNE_CHECK(memcmp(&r[i], &rec, sizeof(rec)) == 0);
+        }
+    }
+
+    RTUNE_CHECK(run_trace2csv(path.c_str(), csv_path.c_str(), NULL) == 0);
+    FILE *csv = fopen(csv_path.c_str(), "r");
+    RTUNE_CHECK(csv != NULL);
+    char line[256];
+    RTUNE_CHECK(fgets(line, sizeof(line), csv) && strcmp(line, "thread,region,iteration,kind,id,state_index,value,old_status,new_status\n") == 0);
+    uint64_t n = 0;
+    while (fgets(line, sizeof(line), csv)) {
+        char expected[256];
+        rtune_trace_record_t rec = make_record(n);
+        if (rec.kind == RTUNE_TRACE_RECORD_OBJECTIVE) {
+            snprintf(expected, sizeof(expected), "3,7,%u,objective,0,,%.17g,%d,%u\n", rec.iteration, rec.value._double_value,
+                     rec.state_index, rec.status);
+        } else {
+            snprintf(expected, sizeof(expected), "3,7,%u,%s,%u,%d,%d,,\n", rec.iteration,
+                     rec.kind == RTUNE_TRACE_RECORD_VAR ? "var" : "func", rec.id, rec.state_index, rec.value._int_value);
+        }
+        RTUNE_CHECK(strcmp(line, expected) == 0);
+        n++;
+    }
+    fclose(csv);
+    RTUNE_CHECK(n == num_records);
+
+    //a file that is not a trace is rejected
+    RTUNE_CHECK(run_trace2csv(csv_path.c_str(), "/dev/null", "/dev/null") == 1);
+
+    unlink(path.c_str());
+    unlink(csv_path.c_str());
+    rmdir(dir);
+    return 0;
+}
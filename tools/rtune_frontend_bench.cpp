@@ -0,0 +1,120 @@
+/**
+ * rtune_frontend_bench: per-iteration cost of reading the vars and computing a func of a region through the C path
+ * (provider function pointer, dispatch on the var type, func computed by an opaque provider) and through the C++ front end
+ * of rtune.hpp (lambda provider, typed vars, inlined expression template). The vars are set up directly, without the
+ * runtime, so only the work done per iteration on behalf of the vars and the func is measured.
+ *
+ * usage: rtune_frontend_bench [-n iterations]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "../rtune.hpp"
+#include "../rtune_region.h" //rtune_utype_to_double
+#include "../rtune_provider.h"
+
+static double clock_value = 0.0;
+static rtune_var_t vars[3]; //time, threads, chunk
+
+//C path: providers and funcs are opaque functions of void *, the values are read with a dispatch on the type
+__attribute__((noinline)) static double c_read_clock(void *) {
+    return clock_value += 1e-6;
+}
+
+__attribute__((noinline)) static double c_cost(void *arg) {
+    rtune_var_t *const *v = (rtune_var_t *const *) arg;
+    double t = rtune_utype_to_double(v[0]->stvar.type, v[0]->stvar.v);
+    double th = rtune_utype_to_double(v[1]->stvar.type, v[1]->stvar.v);
+    double ch = rtune_utype_to_double(v[2]->stvar.type, v[2]->stvar.v);
+    return 2.0 * t + th * 0.5 - fabs(ch - 100);
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+template <typename F>
+static double ns_per_iteration(long n, F &&body) {
+    clock_type::time_point t = clock_type::now();
+    for (long i = 0; i < n; i++) body(i);
+    return std::chrono::duration<double, std::nano>(clock_type::now() - t).count() / n;
+}
+
+int main(int argc, char *argv[]) {
+    long n = 10000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n': n = atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (n < 1) {
+        fprintf(stderr, "%s: iterations must be positive\n", argv[0]);
+        return 1;
+    }
+
+    vars[0].stvar.type = RTUNE_double;
+    vars[1].stvar.type = RTUNE_int;
+    vars[1].stvar.v._int_value = 16;
+    vars[2].stvar.type = RTUNE_int;
+    vars[2].stvar.v._int_value = 64;
+    rtune_var_t *inputs[3] = {&vars[0], &vars[1], &vars[2]};
+    stvar_t cost;
+    cost.type = RTUNE_double;
+    cost.provider = rtune::detail::provider_cast(&c_cost);
+    cost.provider_arg = inputs;
+    cost.provider_kind = RTUNE_PROVIDER_USER;
+
+    volatile double sink = 0.0;
+    double base = clock_value;
+
+    //C: the time var and the cost func read through rtune_provider_read
+    vars[0].stvar.provider = rtune::detail::provider_cast(&c_read_clock);
+    vars[0].stvar.provider_arg = nullptr;
+    vars[0].stvar.provider_kind = RTUNE_PROVIDER_USER;
+    double c_ns = ns_per_iteration(n, [&](long) {
+        rtune_provider_read(&vars[0].stvar, &vars[0].stvar.v);
+        utype_t u;
+        rtune_provider_read(&cost, &u);
+        sink = sink + u._double_value;
+    });
+
+    //C++, called by the runtime: the lambda provider through its thunk, the expression through the provider of its ext func
+    clock_value = base;
+    auto read_clock = [] { return clock_value += 1e-6; };
+    rtune::detail::holder<decltype(read_clock)> clock_holder(read_clock);
+    vars[0].stvar.provider = rtune::detail::provider_ptr<double, decltype(read_clock)>();
+    vars[0].stvar.provider_arg = &clock_holder;
+    rtune::var<double> t(&vars[0]);
+    rtune::var<int> th(&vars[1]), ch(&vars[2]);
+    auto expr = 2.0 * t + th * 0.5 - rtune::abs(ch - 100);
+    rtune::detail::holder<decltype(expr)> expr_holder(expr);
+    cost.provider = rtune::detail::provider_cast(
+        +[](void *arg) { return static_cast<rtune::detail::holder<decltype(expr)> *>(arg)->f.eval(); });
+    cost.provider_arg = &expr_holder;
+    double thunk_ns = ns_per_iteration(n, [&](long) {
+        rtune_provider_read(&vars[0].stvar, &vars[0].stvar.v);
+        utype_t u;
+        rtune_provider_read(&cost, &u);
+        sink = sink + u._double_value;
+    });
+
+    //C++, in the application: the time var is read by the runtime through its thunk as above, and the func is computed
+    //through its rtune::func handle, whose eval() is the expression inlined at the call site
+    clock_value = base;
+    rtune_func_t cost_func;
+    cost_func.stvar = cost;
+    rtune::func<decltype(expr)> f(&cost_func, &expr);
+    double inline_ns = ns_per_iteration(n, [&](long) {
+        rtune_provider_read(&vars[0].stvar, &vars[0].stvar.v);
+        sink = sink + f.eval();
+    });
+
+    printf("%-28s %10s\n", "path", "ns/iter");
+    printf("%-28s %10.2f\n", "c_provider_dispatch", c_ns);
+    printf("%-28s %10.2f\n", "cxx_lambda_thunk", thunk_ns);
+    printf("%-28s %10.2f\n", "cxx_inlined", inline_ns);
+    return 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * rtune_replay_bench: compare the search strategies and fidelity settings of objectives on synthetic response surfaces,
+ * or on recorded samples, with the replay harness of rtune_replay.hpp.
+ *
+ * usage: rtune_replay_bench [-r runs] [-f fidelity_window] [-t deviation_tolerance] [-l lookup_window] [recorded.csv]
+ *
+ * recorded.csv has "index,value" lines, one per recorded sample of the objective func for the value index of a var.
+ * For each surface and strategy, the mean over the runs of the iterations to convergence, the regret against the true
+ * optimum and the search time per evaluation are printed.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <unistd.h>
+#include "../rtune_replay.hpp"
+
+using namespace rtune::replay;
+
+static const struct {
+    rtune_objective_search_strategy_t strategy;
+    const char *name;
+} strategies[] = {
+    {RTUNE_OBJECTIVE_SEARCH_EXHAUSTIVE_AFTER_COMPLETE, "exhaustive_after_complete"},
+    {RTUNE_OBJECTIVE_SEARCH_EXHAUSTIVE_ON_THE_FLY, "exhaustive_on_the_fly"},
+    {RTUNE_OBJECTIVE_SEARCH_UNIMODAL_ON_THE_FLY, "unimodal_on_the_fly"},
+    {RTUNE_OBJECTIVE_SEARCH_RANDOM, "random"},
+    {RTUNE_OBJECTIVE_SEARCH_NELDER_MEAD, "nelder_mead"},
+    {RTUNE_OBJECTIVE_SEARCH_BINARY_GRADIENT, "binary_gradient"},
+    {RTUNE_OBJECTIVE_SEARCH_QUATERNARY_GRADIENT, "quaternary_gradient"},
+    {RTUNE_OBJECTIVE_SEARCH_OCTAL_GRADIENT, "octal_gradient"},
+    {RTUNE_OBJECTIVE_SEARCH_HEX_GRADIENT, "hex_gradient"},
+    {RTUNE_OBJECTIVE_SEARCH_SUCCESSIVE_HALVING, "successive_halving"},
+    {RTUNE_OBJECTIVE_SEARCH_UCB, "ucb"},
+};
+
+static void bench(const char *surface_name, const surface &s, settings st, int runs) {
+    for (const auto &strategy : strategies) {
+        st.search_strategy = strategy.strategy;
+        double iterations = 0.0, regret = 0.0, ns = 0.0;
+        bool supported = true;
+        for (int run = 0; run < runs && supported; run++) {
+            result r = harness(s, st, 1000 + run).run();
+            supported = r.supported;
+            iterations += r.iterations;
+            regret += r.regret;
+            ns += r.ns_per_evaluation;
+        }
+        if (!supported) {
+            printf("%-12s %-26s %10s\n", surface_name, strategy.name, "unsupported");
+            continue;
+        }
+        printf("%-12s %-26s %10.1f %10.4f %12.1f\n", surface_name, strategy.name, iterations / runs, regret / runs, ns / runs);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    settings st;
+    int runs = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:f:t:l:")) != -1) {
+        switch (opt) {
+            case 'r': runs = atoi(optarg); break;
+            case 'f': st.fidelity_window = atoi(optarg); break;
+            case 't': st.deviation_tolerance = atof(optarg); break;
+            case 'l': st.lookup_window = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-r runs] [-f fidelity_window] [-t deviation_tolerance] [-l lookup_window] [recorded.csv]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (runs < 1 || st.fidelity_window < 1) {
+        fprintf(stderr, "%s: runs and fidelity_window must be positive\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-12s %-26s %10s %10s %12s\n", "surface", "strategy", "iterations", "regret", "ns/eval");
+    if (optind < argc) {
+        FILE *in = fopen(argv[optind], "r");
+        recorded_surface recorded(std::vector<std::vector<double>>(0));
+        if (!in || !recorded.load_csv(in)) {
+            fprintf(stderr, "%s: cannot read samples from %s\n", argv[0], argv[optind]);
+            if (in) fclose(in);
+            return 1;
+        }
+        fclose(in);
+        bench("recorded", recorded, st, runs);
+        return 0;
+    }
+
+    //a num_threads range of 64 values, and num_threads x cpu frequency of 64x16 values
+    bench("unimodal", unimodal_surface({64}, {41}, 0.02), st, runs);
+    bench("multimodal", multimodal_surface({64}, {41}, 0.02, 8, 0.05), st, runs);
+    bench("plateau", plateau_surface({64}, {41}, 0.02, 6), st, runs);
+    bench("unimodal2d", unimodal_surface({64, 16}, {41, 5}, 0.02), st, runs);
+    bench("multimodal2d", multimodal_surface({64, 16}, {41, 5}, 0.02, 8, 0.05), st, runs);
+    bench("plateau2d", plateau_surface({64, 16}, {41, 5}, 0.02, 4), st, runs);
+    return 0;
+}
@@ -0,0 +1,26 @@
+/**
+ * rtune_trace2csv: convert RTune binary trace files (<prefix>.<thread>.rtt) to CSV.
+ *
+ * usage: rtune_trace2csv trace.0.rtt [trace.1.rtt ...] > trace.csv
+ */
+#include <cstdio>
+#include "../rtune_trace.hpp"
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace.rtt [trace.rtt ...]\n", argv[0]);
+        return 1;
+    }
+    int status = 0;
+    rtune::trace::csv_header(stdout);
+    for (int i = 1; i < argc; i++) {
+        rtune::trace::reader r;
+        if (r.open(argv[i]) != 0) {
+            fprintf(stderr, "%s: cannot read trace file %s\n", argv[0], argv[i]);
+            status = 1;
+            continue;
+        }
+        rtune::trace::csv_write(stdout, r);
+    }
+    return status;
+}